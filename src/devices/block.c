@@ -1,9 +1,31 @@
 #include "devices/block.h"
 #include <list.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Most sectors the dispatcher merges into a single transfer. */
+#define MAX_MERGE_SECTORS 256
+
+/* Number of buckets in a latency histogram.  Bucket 0 counts
+   requests that took less than 2 TSC cycles, bucket I > 0 those
+   that took 2**I to 2**(I+1) - 1 cycles, and the last bucket
+   everything slower. */
+#define LATENCY_BUCKETS 40
+
+/* Statistics for requests in one direction on a device. */
+struct io_stats
+  {
+    unsigned long long cnt;             /* Number of requests completed. */
+    unsigned long long seq_cnt;         /* ...that were sequential. */
+    uint64_t total_cycles;              /* Sum of their latencies. */
+    unsigned long long hist[LATENCY_BUCKETS];   /* Latency histogram. */
+  };
 
 /* A block device. */
 struct block
@@ -17,8 +39,38 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
+    /* A partition passes its requests straight to the device it
+       is part of, and has no driver, dispatcher, or bounce buffer
+       of its own. */
+    struct block *parent;               /* Device holding partition,
+                                           or null if not a partition. */
+    block_sector_t start;               /* First sector within parent. */
+
+    /* Updated by the dispatcher, or for a partition under
+       queue_lock. */
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Request queue. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct list queue;                  /* Pending requests, by sector. */
+    struct condition queue_nonempty;    /* Signaled on submission. */
+    unsigned next_seq;                  /* Next submission number. */
+    block_sector_t head;                /* Sector after last transfer. */
+    size_t in_flight;                   /* Requests taken from queue and
+                                           not yet completed. */
+
+    /* Request statistics, also protected by queue_lock. */
+    block_sector_t next_sector;         /* Sector after last submitted. */
+    struct io_stats read_stats;         /* Reads. */
+    struct io_stats write_stats;        /* Writes. */
+    unsigned long long depth_samples;   /* Number of depth samples. */
+    unsigned long long depth_sum;       /* Sum of sampled depths. */
+    size_t depth_max;                   /* Largest sampled depth. */
+
+    /* Bounce buffer for transfers to and from user memory. */
+    struct lock bounce_lock;            /* Protects bounce_page. */
+    uint8_t *bounce_page;               /* One page. */
   };
 
 /* List of all block devices. */
@@ -27,7 +79,30 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
+static struct block *new_block (const char *name, enum block_type,
+                                block_sector_t size);
+static void announce (const struct block *, const char *extra_info);
 static struct block *list_elem_to_block (struct list_elem *);
+static struct block *resolve (struct block *, bool write,
+                              block_sector_t *sector, block_sector_t cnt);
+static bool request_less (const struct list_elem *,
+                          const struct list_elem *, void *aux);
+static void dispatch (void *block_);
+static void record_completion (struct block *, struct block_request *,
+                               uint64_t now);
+static void print_io_stats (const char *op, const struct io_stats *);
+static bool sg_in_kernel (const struct block_sg *, block_sector_t cnt);
+static void bounce (struct block *, bool write, block_sector_t sector,
+                    block_sector_t cnt, const struct block_sg *);
+
+/* Returns the processor's time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +195,8 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  struct block_sg sg = { buffer, 1 };
+  block_read_multiple (block, sector, 1, &sg);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +207,195 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
+  struct block_sg sg = { (void *) buffer, 1 };
+  block_write_multiple (block, sector, 1, &sg);
+}
+
+/* Verifies that the CNT sectors starting at SECTOR lie within
+   BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
+{
+  ASSERT (cnt > 0);
   check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%"PRDSNu", "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt, block->size);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from BLOCK
+   into the buffers described by scatter-gather list SG, which
+   must cover at least CNT sectors.  Drivers that support it
+   transfer all of them in a single request.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     block_sector_t cnt, const struct block_sg *sg)
+{
+  block = resolve (block, false, &sector, cnt);
+  if (sg_in_kernel (sg, cnt))
+    {
+      struct block_request r;
+
+      block_request_init (&r, false, sector, cnt, sg, NULL, NULL);
+      block_submit (block, &r);
+      block_wait (&r);
+    }
+  else
+    bounce (block, false, sector, cnt, sg);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+   from the buffers described by scatter-gather list SG, which
+   must cover at least CNT sectors.  Returns after the block
+   device has acknowledged receiving all of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      block_sector_t cnt, const struct block_sg *sg)
+{
+  block = resolve (block, true, &sector, cnt);
+  if (sg_in_kernel (sg, cnt))
+    {
+      struct block_request r;
+
+      block_request_init (&r, true, sector, cnt, sg, NULL, NULL);
+      block_submit (block, &r);
+      block_wait (&r);
+    }
+  else
+    bounce (block, true, sector, cnt, sg);
+}
+
+/* Returns true if the buffers for the first CNT sectors of SG
+   all lie in kernel virtual memory. */
+static bool
+sg_in_kernel (const struct block_sg *sg, block_sector_t cnt)
+{
+  for (; cnt > 0; sg++)
+    {
+      if (!is_kernel_vaddr (sg->buffer))
+        return false;
+      cnt -= sg->cnt < cnt ? sg->cnt : cnt;
+    }
+  return true;
+}
+
+/* Transfers the CNT sectors starting at SECTOR between BLOCK and
+   SG, some of whose buffers are in user memory, a page at a time
+   through a kernel bounce buffer.  Requests are carried out by
+   BLOCK's dispatcher thread, which does not have the current
+   process's page directory, so user memory may only be touched
+   here in the caller's own context.  The bounce buffer is
+   allocated with the device, so this cannot fail for lack of
+   memory; concurrent callers take turns using it. */
+static void
+bounce (struct block *block, bool write, block_sector_t sector,
+        block_sector_t cnt, const struct block_sg *sg)
+{
+  enum { PAGE_SECTORS = PGSIZE / BLOCK_SECTOR_SIZE };
+  uint8_t *page = block->bounce_page;
+  block_sector_t ofs;
+
+  lock_acquire (&block->bounce_lock);
+  for (ofs = 0; ofs < cnt; ofs += PAGE_SECTORS)
+    {
+      block_sector_t chunk = (cnt - ofs < PAGE_SECTORS
+                              ? cnt - ofs : PAGE_SECTORS);
+      struct block_sg page_sg = { page, chunk };
+      struct block_request r;
+      block_sector_t i;
+
+      if (write)
+        for (i = 0; i < chunk; i++)
+          memcpy (page + i * BLOCK_SECTOR_SIZE, block_sg_sector (sg, ofs + i),
+                  BLOCK_SECTOR_SIZE);
+      block_request_init (&r, write, sector + ofs, chunk, &page_sg,
+                          NULL, NULL);
+      block_submit (block, &r);
+      block_wait (&r);
+      if (!write)
+        for (i = 0; i < chunk; i++)
+          memcpy (block_sg_sector (sg, ofs + i), page + i * BLOCK_SECTOR_SIZE,
+                  BLOCK_SECTOR_SIZE);
+    }
+  lock_release (&block->bounce_lock);
+}
+
+/* Returns the buffer for sector IDX, counting from 0, of the
+   transfer described by scatter-gather list SG. */
+void *
+block_sg_sector (const struct block_sg *sg, block_sector_t idx)
+{
+  while (idx >= sg->cnt)
+    idx -= sg++->cnt;
+  return (uint8_t *) sg->buffer + idx * BLOCK_SECTOR_SIZE;
+}
+
+/* Initializes R as a request to read (if WRITE is false) or
+   write (if WRITE is true) the CNT sectors starting at SECTOR,
+   using the buffers described by SG.  On completion, COMPLETE
+   will be called with R and AUX; if COMPLETE is null, the caller
+   should instead wait for the request with block_wait(). */
+void
+block_request_init (struct block_request *r, bool write,
+                    block_sector_t sector, block_sector_t cnt,
+                    const struct block_sg *sg,
+                    block_complete_func *complete, void *aux)
+{
+  r->write = write;
+  r->sector = sector;
+  r->cnt = cnt;
+  r->sg = sg;
+  r->complete = complete;
+  r->aux = aux;
+  sema_init (&r->done, 0);
+}
+
+/* Queues request R on BLOCK and returns without waiting for it.
+   BLOCK's dispatcher thread serves queued requests in C-SCAN
+   order, merging requests for adjacent sectors into a single
+   transfer.  If BLOCK is a partition, R goes directly to the
+   queue of the device it is part of, and R->sector is changed to
+   the corresponding sector of that device. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  block = resolve (block, r->write, &r->sector, r->cnt);
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+  ASSERT (sg_in_kernel (r->sg, r->cnt));
+
+  lock_acquire (&block->queue_lock);
+  r->seq = block->next_seq++;
+  r->submit_tsc = rdtsc ();
+  r->sequential = r->sector == block->next_sector;
+  block->next_sector = r->sector + r->cnt;
+
+  /* Sample the number of requests already outstanding. */
+  {
+    size_t depth = list_size (&block->queue) + block->in_flight;
+    block->depth_samples++;
+    block->depth_sum += depth;
+    if (depth > block->depth_max)
+      block->depth_max = depth;
+  }
+
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  cond_signal (&block->queue_nonempty, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for request R, which must have been initialized without a
+   completion function, to complete. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->complete == NULL);
+  sema_down (&r->done);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,10 +419,13 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Prints statistics for each block device used for a Pintos
+   role, then request latency and queue depth statistics for
+   every block device that served any requests. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -176,6 +438,105 @@ block_print_stats (void)
                   block->read_cnt, block->write_cnt);
         }
     }
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      if (block->depth_samples == 0)
+        continue;
+
+      printf ("%s (%s): queue depth avg %llu.%02llu, max %zu\n",
+              block->name, block_type_name (block->type),
+              block->depth_sum / block->depth_samples,
+              block->depth_sum * 100 / block->depth_samples % 100,
+              block->depth_max);
+      print_io_stats ("read", &block->read_stats);
+      print_io_stats ("write", &block->write_stats);
+    }
+}
+
+/* Prints the statistics in S for requests of kind OP, if there
+   were any: counts, mean latency, and the non-empty buckets of
+   the latency histogram as "LOG2_CYCLES:COUNT" pairs. */
+static void
+print_io_stats (const char *op, const struct io_stats *s)
+{
+  int i;
+
+  if (s->cnt == 0)
+    return;
+
+  printf ("  %s: %llu requests, %llu sequential, %llu random, "
+          "avg %llu cycles\n  %s latency:",
+          op, s->cnt, s->seq_cnt, s->cnt - s->seq_cnt,
+          s->total_cycles / s->cnt, op);
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    if (s->hist[i] != 0)
+      printf (" %d:%llu", i, s->hist[i]);
+  printf ("\n");
+}
+
+/* Appends a line formatted as by printf() to the LEN bytes
+   already in BUFFER, which has room for SIZE bytes, truncating
+   as necessary, and advances LEN by the full line length. */
+static void PRINTF_FORMAT (4, 5)
+csv_printf (char *buffer, size_t size, size_t *len, const char *format, ...)
+{
+  va_list args;
+
+  va_start (args, format);
+  *len += vsnprintf (*len < size ? buffer + *len : NULL,
+                     *len < size ? size - *len : 0, format, args);
+  va_end (args);
+}
+
+/* Formats the request statistics of every block device as CSV,
+   one line per device and direction, into BUFFER, which has room
+   for SIZE bytes.  Like snprintf(), always null-terminates BUFFER
+   if SIZE is nonzero and returns the full length of the output,
+   not counting the null terminator. */
+size_t
+block_stats_csv (char *buffer, size_t size)
+{
+  struct list_elem *e;
+  size_t len = 0;
+  int i;
+
+  if (size > 0)
+    buffer[0] = '\0';
+
+  csv_printf (buffer, size, &len, "device,type,op,sectors,requests,"
+              "sequential,total_cycles,depth_samples,depth_sum,depth_max");
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    csv_printf (buffer, size, &len, ",lat_%d", i);
+  csv_printf (buffer, size, &len, "\n");
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      int op;
+
+      for (op = 0; op < 2; op++)
+        {
+          const struct io_stats *s = op ? &block->write_stats
+                                        : &block->read_stats;
+          csv_printf (buffer, size, &len,
+                      "%s,%s,%s,%llu,%llu,%llu,%llu,%llu,%llu,%zu",
+                      block->name, block_type_name (block->type),
+                      op ? "write" : "read",
+                      op ? block->write_cnt : block->read_cnt,
+                      s->cnt, s->seq_cnt,
+                      (unsigned long long) s->total_cycles,
+                      block->depth_samples, block->depth_sum,
+                      block->depth_max);
+          for (i = 0; i < LATENCY_BUCKETS; i++)
+            csv_printf (buffer, size, &len, ",%llu", s->hist[i]);
+          csv_printf (buffer, size, &len, "\n");
+        }
+    }
+  return len;
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -188,7 +549,48 @@ block_register (const char *name, enum block_type type,
                 const char *extra_info, block_sector_t size,
                 const struct block_operations *ops, void *aux)
 {
-  struct block *block = malloc (sizeof *block);
+  struct block *block = new_block (name, type, size);
+
+  block->ops = ops;
+  block->aux = aux;
+  lock_init (&block->bounce_lock);
+  block->bounce_page = palloc_get_page (0);
+  if (block->bounce_page == NULL)
+    PANIC ("Failed to allocate bounce buffer for block device %s",
+           block->name);
+  if (thread_create (block->name, PRI_MAX, dispatch, block) == TID_ERROR)
+    PANIC ("Failed to start dispatcher for block device %s", block->name);
+
+  announce (block, extra_info);
+  return block;
+}
+
+/* Registers a new block device with the given NAME, TYPE, and
+   SIZE in sectors, as a partition of PARENT starting at its
+   sector START.  EXTRA_INFO is as for block_register().  The
+   partition's requests are queued directly on PARENT. */
+struct block *
+block_register_partition (const char *name, enum block_type type,
+                          const char *extra_info, block_sector_t size,
+                          struct block *parent, block_sector_t start)
+{
+  struct block *block = new_block (name, type, size);
+
+  ASSERT (parent->parent == NULL);
+  block->parent = parent;
+  block->start = start;
+
+  announce (block, extra_info);
+  return block;
+}
+
+/* Allocates a block device with the given NAME, TYPE, and SIZE
+   in sectors, adds it to all_blocks, and initializes everything
+   but its driver. */
+static struct block *
+new_block (const char *name, enum block_type type, block_sector_t size)
+{
+  struct block *block = calloc (1, sizeof *block);
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
@@ -196,21 +598,50 @@ block_register (const char *name, enum block_type type,
   strlcpy (block->name, name, sizeof block->name);
   block->type = type;
   block->size = size;
-  block->ops = ops;
-  block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  lock_init (&block->queue_lock);
+  list_init (&block->queue);
+  cond_init (&block->queue_nonempty);
+  return block;
+}
 
+/* Prints a line describing newly registered BLOCK, with
+   EXTRA_INFO if it is non-null. */
+static void
+announce (const struct block *block, const char *extra_info)
+{
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
   printf (")");
   if (extra_info != NULL)
     printf (", %s", extra_info);
   printf ("\n");
+}
 
-  return block;
+/* If BLOCK is a partition, checks that the CNT sectors starting
+   at *SECTOR lie within it, adds them to its statistics as
+   written if WRITE is true or as read otherwise, and returns the
+   device it is part of, with *SECTOR translated to that device.
+   Otherwise returns BLOCK unchanged. */
+static struct block *
+resolve (struct block *block, bool write, block_sector_t *sector,
+         block_sector_t cnt)
+{
+  if (block->parent == NULL)
+    return block;
+
+  check_sectors (block, *sector, cnt);
+  ASSERT (!write || block->type != BLOCK_FOREIGN);
+  lock_acquire (&block->queue_lock);
+  if (write)
+    block->write_cnt += cnt;
+  else
+    block->read_cnt += cnt;
+  lock_release (&block->queue_lock);
+
+  *sector += block->start;
+  return block->parent;
 }
-
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -221,3 +652,339 @@ list_elem_to_block (struct list_elem *list_elem)
           : NULL);
 }
 
+
+/* Request queue. */
+
+/* Returns true if request A's first sector precedes B's. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return a->sector < b->sector;
+}
+
+/* Returns true if R must wait for an earlier-submitted request
+   still in BLOCK's queue, because the two touch a common sector
+   and at least one of them writes it.
+   Must be called with BLOCK's queue_lock held. */
+static bool
+must_wait (struct block *block, const struct block_request *r)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      const struct block_request *q
+        = list_entry (e, struct block_request, elem);
+      if (q->seq < r->seq
+          && (q->write || r->write)
+          && q->sector < r->sector + r->cnt
+          && r->sector < q->sector + q->cnt)
+        return true;
+    }
+  return false;
+}
+
+/* Chooses the next request to serve from BLOCK's queue, which
+   must not be empty.  Requests are served in C-SCAN order: the
+   first one at or after the sector following the last transfer,
+   or the first one in the queue after wrapping around.  A request
+   that would overtake an overlapping earlier one is not served
+   until that one is; the oldest request is served instead.
+   Must be called with BLOCK's queue_lock held. */
+static struct block_request *
+choose_request (struct block *block)
+{
+  struct block_request *r = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      r = list_entry (e, struct block_request, elem);
+      if (r->sector >= block->head)
+        break;
+    }
+  if (e == list_end (&block->queue))
+    r = list_entry (list_front (&block->queue), struct block_request, elem);
+
+  if (must_wait (block, r))
+    for (e = list_begin (&block->queue); e != list_end (&block->queue);
+         e = list_next (e))
+      {
+        struct block_request *q = list_entry (e, struct block_request, elem);
+        if (q->seq < r->seq)
+          r = q;
+      }
+
+  return r;
+}
+
+/* Moves FIRST, and the requests that follow it in BLOCK's queue
+   and can be merged with it into a single transfer, from the
+   queue to BATCH.  Returns the number of sectors in BATCH.
+   Must be called with BLOCK's queue_lock held. */
+static block_sector_t
+take_batch (struct block *block, struct block_request *first,
+            struct list *batch)
+{
+  struct list_elem *e = list_next (&first->elem);
+  block_sector_t cnt = first->cnt;
+
+  list_remove (&first->elem);
+  list_push_back (batch, &first->elem);
+  while (e != list_end (&block->queue))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      e = list_next (e);
+
+      if (r->sector != first->sector + cnt
+          || r->write != first->write
+          || cnt + r->cnt > MAX_MERGE_SECTORS
+          || must_wait (block, r))
+        break;
+
+      list_remove (&r->elem);
+      list_push_back (batch, &r->elem);
+      cnt += r->cnt;
+    }
+  return cnt;
+}
+
+/* Returns the number of elements of scatter-gather list SG needed
+   to cover CNT sectors. */
+static size_t
+sg_length (const struct block_sg *sg, block_sector_t cnt)
+{
+  size_t n;
+
+  for (n = 0; cnt > 0; n++)
+    cnt -= sg[n].cnt < cnt ? sg[n].cnt : cnt;
+  return n;
+}
+
+/* Returns a scatter-gather list that covers the CNT sectors of
+   the requests in BATCH, in order, or a null pointer if memory
+   allocation fails.  The caller must free the list. */
+static struct block_sg *
+merge_sg (struct list *batch)
+{
+  struct block_sg *sg;
+  struct list_elem *e;
+  size_t n = 0;
+
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      n += sg_length (r->sg, r->cnt);
+    }
+
+  sg = malloc (n * sizeof *sg);
+  if (sg == NULL)
+    return NULL;
+
+  n = 0;
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      const struct block_sg *src = r->sg;
+      block_sector_t left;
+
+      for (left = r->cnt; left > 0; left -= sg[n++].cnt)
+        {
+          sg[n].buffer = src->buffer;
+          sg[n].cnt = src->cnt < left ? src->cnt : left;
+          src++;
+        }
+    }
+  return sg;
+}
+
+/* Has BLOCK's driver transfer the CNT sectors starting at
+   SECTOR, as described by WRITE and SG. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector,
+          block_sector_t cnt, const struct block_sg *sg)
+{
+  const struct block_operations *ops = block->ops;
+  block_sector_t i;
+
+  if (write)
+    {
+      if (ops->write_multiple != NULL)
+        ops->write_multiple (block->aux, sector, cnt, sg);
+      else
+        for (i = 0; i < cnt; i++)
+          ops->write (block->aux, sector + i, block_sg_sector (sg, i));
+      block->write_cnt += cnt;
+    }
+  else
+    {
+      if (ops->read_multiple != NULL)
+        ops->read_multiple (block->aux, sector, cnt, sg);
+      else
+        for (i = 0; i < cnt; i++)
+          ops->read (block->aux, sector + i, block_sg_sector (sg, i));
+      block->read_cnt += cnt;
+    }
+}
+
+/* Adds request R, which completed on BLOCK at time stamp NOW, to
+   BLOCK's statistics. */
+static void
+record_completion (struct block *block, struct block_request *r,
+                   uint64_t now)
+{
+  struct io_stats *s = r->write ? &block->write_stats : &block->read_stats;
+  uint64_t cycles = now - r->submit_tsc;
+  int bucket;
+
+  for (bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++)
+    if (cycles >> (bucket + 1) == 0)
+      break;
+
+  lock_acquire (&block->queue_lock);
+  block->in_flight--;
+  s->cnt++;
+  if (r->sequential)
+    s->seq_cnt++;
+  s->total_cycles += cycles;
+  s->hist[bucket]++;
+  lock_release (&block->queue_lock);
+}
+
+/* Completes request R, which finished on BLOCK at time stamp
+   NOW.  R must already be off any list, since its owner may free
+   it as soon as it learns that it is done. */
+static void
+finish (struct block *block, struct block_request *r, uint64_t now)
+{
+  record_completion (block, r, now);
+  if (r->complete != NULL)
+    r->complete (r, r->aux);
+  else
+    sema_up (&r->done);
+}
+
+/* Waits for requests to arrive in BLOCK's queue, then serves the
+   next of them, together with any that can be merged with it
+   into a single transfer. */
+static void
+serve_merged (struct block *block)
+{
+  struct block_request *first;
+  struct block_sg *sg;
+  struct list batch;
+  block_sector_t cnt;
+  uint64_t now;
+
+  list_init (&batch);
+  lock_acquire (&block->queue_lock);
+  while (list_empty (&block->queue))
+    cond_wait (&block->queue_nonempty, &block->queue_lock);
+  first = choose_request (block);
+  cnt = take_batch (block, first, &batch);
+  block->head = first->sector + cnt;
+  block->in_flight = list_size (&batch);
+  lock_release (&block->queue_lock);
+
+  /* Transfer the batch in one go if it has a single request
+     or a merged list can be built, otherwise request by
+     request. */
+  sg = list_size (&batch) > 1 ? merge_sg (&batch) : NULL;
+  if (list_size (&batch) == 1 || sg != NULL)
+    transfer (block, first->write, first->sector, cnt,
+              sg != NULL ? sg : first->sg);
+  else
+    {
+      struct list_elem *e;
+
+      for (e = list_begin (&batch); e != list_end (&batch);
+           e = list_next (e))
+        {
+          struct block_request *r
+            = list_entry (e, struct block_request, elem);
+          transfer (block, r->write, r->sector, r->cnt, r->sg);
+        }
+    }
+  free (sg);
+
+  now = rdtsc ();
+  while (!list_empty (&batch))
+    finish (block, list_entry (list_pop_front (&batch),
+                               struct block_request, elem), now);
+}
+
+/* Returns true if R touches a sector also touched by one of the
+   CNT requests in BATCH and either of the two writes it. */
+static bool
+conflicts (struct block_request **batch, size_t cnt,
+           const struct block_request *r)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      const struct block_request *q = batch[i];
+      if ((q->write || r->write)
+          && q->sector < r->sector + r->cnt
+          && r->sector < q->sector + q->cnt)
+        return true;
+    }
+  return false;
+}
+
+/* Waits for requests to arrive in BLOCK's queue, then has the
+   driver carry out up to BLOCK_BATCH_MAX of them at once, in
+   C-SCAN order, stopping early at any request that conflicts
+   with one already in the batch. */
+static void
+serve_batch (struct block *block)
+{
+  struct block_request *batch[BLOCK_BATCH_MAX];
+  size_t cnt, i;
+  uint64_t now;
+
+  lock_acquire (&block->queue_lock);
+  while (list_empty (&block->queue))
+    cond_wait (&block->queue_nonempty, &block->queue_lock);
+  for (cnt = 0; cnt < BLOCK_BATCH_MAX && !list_empty (&block->queue); cnt++)
+    {
+      struct block_request *r = choose_request (block);
+      if (conflicts (batch, cnt, r))
+        break;
+      list_remove (&r->elem);
+      batch[cnt] = r;
+      block->head = r->sector + r->cnt;
+    }
+  block->in_flight = cnt;
+  lock_release (&block->queue_lock);
+
+  block->ops->transfer_batch (block->aux, batch, cnt);
+  for (i = 0; i < cnt; i++)
+    if (batch[i]->write)
+      block->write_cnt += batch[i]->cnt;
+    else
+      block->read_cnt += batch[i]->cnt;
+
+  now = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    finish (block, batch[i], now);
+}
+
+/* Dispatcher thread for BLOCK.  Serves the requests submitted to
+   BLOCK's queue, forever. */
+static void
+dispatch (void *block_)
+{
+  struct block *block = block_;
+
+  for (;;)
+    if (block->ops->transfer_batch != NULL)
+      serve_batch (block);
+    else
+      serve_merged (block);
+}
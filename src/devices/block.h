@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -22,6 +24,15 @@ typedef uint32_t block_sector_t;
 
 struct block;
 
+/* An element of a scatter-gather list: CNT consecutive sectors'
+   worth of memory at BUFFER.  A multiple-sector transfer fills or
+   drains the elements of its list in order. */
+struct block_sg
+  {
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    block_sector_t cnt;         /* Number of sectors. */
+  };
+
 /* Type of a block device. */
 enum block_type
   {
@@ -53,11 +64,54 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                          const struct block_sg *);
+void block_write_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                           const struct block_sg *);
+void *block_sg_sector (const struct block_sg *, block_sector_t idx);
+
+/* Asynchronous requests. */
+struct block_request;
+
+/* Called, from the device's dispatcher thread, when request R
+   completes.  Must not block for long, since no other request on
+   the device is started until it returns. */
+typedef void block_complete_func (struct block_request *r, void *aux);
+
+/* A request to read or write a run of sectors.
+   Owned by the caller, who must not modify or free it between
+   block_submit() and its completion.  Its buffers must be in
+   kernel memory, because the transfer is carried out by the
+   device's dispatcher thread. */
+struct block_request
+  {
+    struct list_elem elem;              /* Element in device queue. */
+    bool write;                         /* Write (true) or read (false)? */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    const struct block_sg *sg;          /* Buffers, covering CNT sectors. */
+    block_complete_func *complete;      /* Called on completion, or null. */
+    void *aux;                          /* Passed to COMPLETE. */
+    struct semaphore done;              /* Up'd on completion if no
+                                           COMPLETE function. */
+    unsigned seq;                       /* Submission order. */
+    uint64_t submit_tsc;                /* Time stamp at submission. */
+    bool sequential;                    /* Began where the previous
+                                           request ended? */
+  };
+
+void block_request_init (struct block_request *, bool write,
+                         block_sector_t, block_sector_t cnt,
+                         const struct block_sg *,
+                         block_complete_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
 /* Statistics. */
 void block_print_stats (void);
+size_t block_stats_csv (char *, size_t);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,10 +119,36 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors starting at the
+       given sector in a single request.  If null, the block layer
+       falls back to one read or write call per sector. */
+    void (*read_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                           const struct block_sg *);
+    void (*write_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                            const struct block_sg *);
+
+    /* Optional.  Carries out the CNT requests in REQS, at most
+       BLOCK_BATCH_MAX of them, returning once all are done.  No
+       two of them touch a common sector if either writes it, so
+       the driver may have them all in flight at once.  If
+       non-null, the block layer hands the driver batches of
+       requests in place of merging adjacent ones itself, and the
+       functions above are not used. */
+    void (*transfer_batch) (void *aux, struct block_request **reqs,
+                            size_t cnt);
   };
 
+/* Most requests passed to a transfer_batch operation at once. */
+#define BLOCK_BATCH_MAX 16
+
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+struct block *block_register_partition (const char *name, enum block_type,
+                                        const char *extra_info,
+                                        block_sector_t size,
+                                        struct block *parent,
+                                        block_sector_t start);
 
 #endif /* devices/block.h */
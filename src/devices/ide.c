@@ -5,10 +5,13 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -30,10 +33,25 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE registers.  Each channel has its own set of
+   8 ports, starting at the channel's bm_base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits.  Writing 1 clears ERR and INTR. */
+#define BM_STA_ERR 0x02         /* Transfer failed. */
+#define BM_STA_INTR 0x04        /* Disk raised its interrupt. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +67,15 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors a single command can transfer.  A sector count
+   register value of 0 stands for this many. */
+#define MAX_SECTORS_PER_CMD 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +84,32 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple_cnt;           /* Sectors per READ/WRITE MULTIPLE data
+                                   block, or 0 if unsupported. */
+    bool dma;                   /* Transfer by bus master DMA? */
+  };
+
+/* Physical region descriptor, an entry in a PRD table.  Tells
+   the bus master where in physical memory to transfer data. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of region. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT in the last entry. */
+  };
+
+#define PRD_EOT 0x8000                  /* End of table. */
+#define PRD_BOUNDARY 0x10000            /* Regions may not cross this. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))  /* Entries per table. */
+
+/* Sectors transferred and their total latency: the wall-clock
+   time from issuing each command to its completion, including
+   time the issuing thread slept waiting for a DMA interrupt.  It
+   is not the CPU time the transfer used. */
+struct xfer_stats
+  {
+    long long sector_cnt;       /* Number of sectors transferred. */
+    int64_t latency_ticks;      /* Timer ticks from issue to done. */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +125,16 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base port, 0 if none. */
+    struct prd *prdt;           /* PRD table, one page. */
+    struct xfer_stats dma_stats;        /* Transfers by DMA. */
+    struct xfer_stats pio_stats;        /* Transfers by PIO. */
+
+    /* Utilization statistics. */
+    long long cmd_cnt;          /* Number of transfer commands. */
+    int64_t busy_ticks;         /* Timer ticks spent transferring. */
+    int64_t busy_start;         /* When the current transfer began. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,11 +144,44 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+/* If false (kernel command-line option "-no-dma"), all transfers
+   use PIO even if bus master DMA is available. */
+bool ide_use_dma = true;
+
+/* Utilization statistics for the channels as a whole.
+   Updated with interrupts off. */
+static int64_t start_ticks;             /* When ide_init() ran. */
+static int busy_channel_cnt;            /* Channels now transferring. */
+static int64_t overlap_ticks;           /* Ticks with both channels busy. */
+static int64_t overlap_start;           /* When both became busy. */
+
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
-
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, int cnt);
+static uint16_t find_bus_master (void);
+
+static void ide_read_multiple (void *, block_sector_t, block_sector_t,
+                               const struct block_sg *);
+static void ide_write_multiple (void *, block_sector_t, block_sector_t,
+                                const struct block_sg *);
+static void transfer (struct ata_disk *, block_sector_t, block_sector_t cnt,
+                      const struct block_sg *, bool write);
+static void pio_read (struct ata_disk *, block_sector_t, block_sector_t cnt,
+                      const struct block_sg *, block_sector_t ofs);
+static void pio_write (struct ata_disk *, block_sector_t, block_sector_t cnt,
+                       const struct block_sg *, block_sector_t ofs);
+static bool build_prdt (struct channel *, const struct block_sg *,
+                        block_sector_t ofs, block_sector_t cnt);
+static void dma_transfer (struct ata_disk *, block_sector_t,
+                          block_sector_t cnt, bool write);
+static void print_xfer_stats (const struct channel *, const char *mode,
+                              const struct xfer_stats *);
+static void mark_busy (struct channel *);
+static void mark_idle (struct channel *);
+
+static void select_sector (struct ata_disk *, block_sector_t,
+                           block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -101,8 +197,11 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = ide_use_dma ? find_bus_master () : 0;
   size_t chan_no;
 
+  start_ticks = timer_ticks ();
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -126,6 +225,16 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+
+      /* Set up bus master DMA, if available. */
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +245,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple_cnt = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -265,6 +376,7 @@ identify_ata_device (struct ata_disk *d)
   char *model, *serial;
   char extra_info[128];
   struct block *block;
+  int max_multiple;
 
   ASSERT (d->is_ata);
 
@@ -284,6 +396,8 @@ identify_ata_device (struct ata_disk *d)
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  max_multiple = *(uint8_t *) &id[47 * 2];
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x0100) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
@@ -303,12 +417,72 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Transfer as many sectors per interrupt as the disk allows. */
+  if (max_multiple > 0)
+    set_multiple_mode (d, max_multiple);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Sends a SET MULTIPLE MODE command to disk D, asking for CNT
+   sectors per data block in READ MULTIPLE and WRITE MULTIPLE
+   commands.  Sets D's multiple_cnt to CNT if the disk accepts,
+   otherwise to 0. */
+static void
+set_multiple_mode (struct ata_disk *d, int cnt) 
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  d->multiple_cnt = (inb (reg_status (c)) & STA_ERR) == 0 ? cnt : 0;
+}
+
+/* PCI class and subclass of IDE controllers. */
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+
+/* Looks for a PCI IDE controller capable of bus mastering, such
+   as the PIIX in QEMU and Bochs, that drives both channels at
+   the legacy ports used by this file.  If there is one, enables
+   it as a bus master and returns the base I/O port of its bus
+   master registers.  Otherwise returns 0, and all transfers use
+   PIO. */
+static uint16_t
+find_bus_master (void) 
+{
+  struct pci_addr addr;
+  uint8_t prog_if;
+  uint32_t bar;
+
+  if (!pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &addr))
+    return 0;
+
+  /* Bit 7 of the programming interface says the controller can
+     be a bus master.  Bits 0 and 2 say a channel runs in native
+     mode, at ports other than the legacy ones. */
+  prog_if = pci_read_config (addr, PCI_REG_CLASS) >> 8;
+  if ((prog_if & 0x80) == 0 || (prog_if & 0x05) != 0)
+    return 0;
+
+  /* The bus master registers are in I/O space, at BAR 4. */
+  if ((pci_read_config (addr, PCI_REG_BAR0 + 4 * 4) & 1) == 0)
+    return 0;
+  bar = pci_read_bar (addr, 4);
+  if (bar == 0 || bar > 0xfff0)
+    return 0;
+
+  pci_enable (addr, PCI_CMD_IO | PCI_CMD_MASTER);
+  printf ("ide: bus master DMA at port %#"PRIx32"\n", bar);
+  return bar;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -344,16 +518,8 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  struct block_sg sg = { buffer, 1 };
+  ide_read_multiple (d_, sec_no, 1, &sg);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -364,36 +530,315 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  struct block_sg sg = { (void *) buffer, 1 };
+  ide_write_multiple (d_, sec_no, 1, &sg);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into the
+   buffers described by SG.  Each run of up to
+   MAX_SECTORS_PER_CMD sectors is a single command: READ DMA if
+   the disk and its buffers allow it, otherwise READ MULTIPLE,
+   or a multiple-sector READ SECTOR if the disk does not support
+   multiple mode either.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                   const struct block_sg *sg)
+{
+  transfer (d_, sec_no, cnt, sg, false);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from the
+   buffers described by SG, as ide_read_multiple() does for
+   reads.  Returns after the disk has acknowledged receiving all
+   of the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                    const struct block_sg *sg)
+{
+  transfer (d_, sec_no, cnt, sg, true);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    NULL
   };
+
+/* Prints utilization and DMA and PIO transfer statistics for each
+   channel, and how long both channels were busy at once. */
+void
+ide_print_stats (void) 
+{
+  int64_t elapsed = timer_elapsed (start_ticks);
+  struct channel *c;
+
+  for (c = channels; c < channels + CHANNEL_CNT; c++)
+    {
+      printf ("%s: %lld commands, busy %lld of %lld ticks (%lld%%)\n",
+              c->name, c->cmd_cnt, c->busy_ticks, elapsed,
+              elapsed > 0 ? c->busy_ticks * 100 / elapsed : 0);
+      print_xfer_stats (c, "DMA", &c->dma_stats);
+      print_xfer_stats (c, "PIO", &c->pio_stats);
+    }
+  printf ("ide: both channels busy for %lld ticks\n", overlap_ticks);
+}
+
+/* Prints the statistics in S for transfer mode MODE on channel
+   C, if any sectors were transferred that way. */
+static void
+print_xfer_stats (const struct channel *c, const char *mode,
+                  const struct xfer_stats *s) 
+{
+  if (s->sector_cnt > 0)
+    printf ("%s: %s %lld sectors, latency %lld ticks (%lld ticks/MB)\n",
+            c->name, mode, s->sector_cnt, s->latency_ticks,
+            s->latency_ticks * (1024 * 1024 / BLOCK_SECTOR_SIZE)
+            / s->sector_cnt);
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D
+   and the buffers described by SG: from D if WRITE is false, to
+   D if it is true.  Runs that cannot use DMA fall back to PIO. */
+static void
+transfer (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+          const struct block_sg *sg, bool write)
+{
+  struct channel *c = d->channel;
+  block_sector_t ofs = 0;
+
+  /* Each channel has its own lock, so transfers on the two
+     channels, issued by different block device dispatchers,
+     proceed at the same time. */
+  lock_acquire (&c->lock);
+  mark_busy (c);
+  while (ofs < cnt)
+    {
+      block_sector_t run = cnt - ofs;
+      struct xfer_stats *stats;
+      int64_t start;
+
+      if (run > MAX_SECTORS_PER_CMD)
+        run = MAX_SECTORS_PER_CMD;
+
+      start = timer_ticks ();
+      if (d->dma && build_prdt (c, sg, ofs, run))
+        {
+          dma_transfer (d, sec_no + ofs, run, write);
+          stats = &c->dma_stats;
+        }
+      else
+        {
+          if (write)
+            pio_write (d, sec_no + ofs, run, sg, ofs);
+          else
+            pio_read (d, sec_no + ofs, run, sg, ofs);
+          stats = &c->pio_stats;
+        }
+      stats->sector_cnt += run;
+      stats->latency_ticks += timer_elapsed (start);
+      c->cmd_cnt++;
+
+      ofs += run;
+    }
+  mark_idle (c);
+  lock_release (&c->lock);
+}
+
+/* Records that channel C has started transferring. */
+static void
+mark_busy (struct channel *c) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  c->busy_start = timer_ticks ();
+  if (++busy_channel_cnt == CHANNEL_CNT)
+    overlap_start = c->busy_start;
+  intr_set_level (old_level);
+}
+
+/* Records that channel C has stopped transferring. */
+static void
+mark_idle (struct channel *c) 
+{
+  enum intr_level old_level = intr_disable ();
+  int64_t now = timer_ticks ();
+
+  c->busy_ticks += now - c->busy_start;
+  if (busy_channel_cnt-- == CHANNEL_CNT)
+    overlap_ticks += now - overlap_start;
+  intr_set_level (old_level);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   sectors OFS...OFS + CNT - 1 of SG using PIO.  CNT must not
+   exceed MAX_SECTORS_PER_CMD.  D's channel must be locked. */
+static void
+pio_read (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+          const struct block_sg *sg, block_sector_t ofs)
+{
+  struct channel *c = d->channel;
+  block_sector_t per_block = d->multiple_cnt > 0 ? d->multiple_cnt : 1;
+  block_sector_t done;
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, (d->multiple_cnt > 0
+                         ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY));
+
+  /* The disk interrupts once per data block. */
+  for (done = 0; done < cnt; )
+    {
+      block_sector_t end = done + per_block < cnt ? done + per_block : cnt;
+
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no + done);
+      for (; done < end; done++)
+        input_sector (c, block_sg_sector (sg, ofs + done));
+    }
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   sectors OFS...OFS + CNT - 1 of SG using PIO.  CNT must not
+   exceed MAX_SECTORS_PER_CMD.  D's channel must be locked. */
+static void
+pio_write (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+           const struct block_sg *sg, block_sector_t ofs)
+{
+  struct channel *c = d->channel;
+  block_sector_t per_block = d->multiple_cnt > 0 ? d->multiple_cnt : 1;
+  block_sector_t done;
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, (d->multiple_cnt > 0
+                         ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY));
+
+  /* The disk asks for each data block in turn and interrupts
+     after accepting it. */
+  for (done = 0; done < cnt; )
+    {
+      block_sector_t end = done + per_block < cnt ? done + per_block : cnt;
+
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no + done);
+      for (; done < end; done++)
+        output_sector (c, block_sg_sector (sg, ofs + done));
+      sema_down (&c->completion_wait);
+    }
+}
+
+
+/* Bus master DMA. */
+
+/* Fills in channel C's PRD table to describe sectors
+   OFS...OFS + CNT - 1 of SG.  Returns true if successful, false
+   if some buffer cannot be reached by DMA, in which case the
+   caller should use PIO instead. */
+static bool
+build_prdt (struct channel *c, const struct block_sg *sg,
+            block_sector_t ofs, block_sector_t cnt)
+{
+  struct prd *prd = c->prdt;
+  size_t prd_cnt = 0;
+  block_sector_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      const uint8_t *buffer = block_sg_sector (sg, ofs + i);
+      uintptr_t addr;
+      size_t left;
+
+      /* Only kernel virtual addresses map directly to physical
+         memory, and the controller transfers whole words. */
+      if (!is_kernel_vaddr (buffer) || (uintptr_t) buffer % 2 != 0)
+        return false;
+
+      addr = vtop (buffer);
+      for (left = BLOCK_SECTOR_SIZE; left > 0; )
+        {
+          /* A region may not cross a 64 kB boundary. */
+          size_t size = PRD_BOUNDARY - addr % PRD_BOUNDARY;
+          if (size > left)
+            size = left;
+
+          /* Extend the previous region if this one follows it.
+             A region that grows to a full 64 kB wraps its size
+             field around to 0, which the controller reads as
+             64 kB. */
+          if (prd_cnt > 0 && addr % PRD_BOUNDARY != 0
+              && prd[prd_cnt - 1].addr + prd[prd_cnt - 1].size == addr)
+            prd[prd_cnt - 1].size += size;
+          else if (prd_cnt < PRD_CNT)
+            {
+              prd[prd_cnt].addr = addr;
+              prd[prd_cnt].size = size;
+              prd[prd_cnt].flags = 0;
+              prd_cnt++;
+            }
+          else
+            return false;
+
+          addr += size;
+          left -= size;
+        }
+    }
+
+  prd[prd_cnt - 1].flags = PRD_EOT;
+  return true;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D
+   and the memory described by its channel's PRD table, by bus
+   master DMA.  CNT must not exceed MAX_SECTORS_PER_CMD.  D's
+   channel must be locked. */
+static void
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+              bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t bm_status;
+
+  /* Point the controller at the PRD table and clear any stale
+     error and interrupt status. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+
+  /* Start the disk command, then the controller's engine. */
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+
+  /* The disk interrupts once after the last sector. */
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), direction);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+  if ((bm_status & BM_STA_ERR) != 0 || (inb (reg_alt_status (c)) & STA_ERR))
+    PANIC ("%s: DMA %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+}
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number of sectors to transfer, CNT, to
+   the disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -1,6 +1,13 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+
+/* Use bus master DMA when available?
+   Controlled by kernel command-line option "-no-dma". */
+extern bool ide_use_dma;
+
 void ide_init (void);
+void ide_print_stats (void);
 
 #endif /* devices/ide.h */
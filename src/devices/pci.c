@@ -0,0 +1,192 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* The code in this file is a minimal interface to PCI
+   configuration space through configuration mechanism #1, the
+   pair of I/O ports that every PC chipset since the i440 family
+   decodes.  It is just enough to locate a device and find its
+   I/O resources. */
+
+/* Configuration mechanism #1 I/O ports. */
+#define CONFIG_ADDRESS 0xcf8    /* Selects a configuration register. */
+#define CONFIG_DATA 0xcfc       /* Reads or writes the selected register. */
+
+/* Value read from the ID register of an absent function. */
+#define NO_VENDOR 0xffff
+
+static void select_register (struct pci_addr, uint8_t reg);
+static bool find (bool (*match) (struct pci_addr, uint32_t id,
+                                 uint32_t class, const void *aux),
+                  const void *aux, const struct pci_addr *after,
+                  struct pci_addr *);
+
+/* Returns the 32-bit configuration register REG, which must be a
+   multiple of 4, of the function at ADDR. */
+uint32_t
+pci_read_config (struct pci_addr addr, uint8_t reg)
+{
+  select_register (addr, reg);
+  return inl (CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit configuration register REG, which
+   must be a multiple of 4, of the function at ADDR. */
+void
+pci_write_config (struct pci_addr addr, uint8_t reg, uint32_t value)
+{
+  select_register (addr, reg);
+  outl (CONFIG_DATA, value);
+}
+
+/* Returns base address register BAR, 0...5, of the function at
+   ADDR, with the low bits that describe the region masked off.
+   Returns 0 if the BAR is not in use. */
+uint32_t
+pci_read_bar (struct pci_addr addr, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+  value = pci_read_config (addr, PCI_REG_BAR0 + bar * 4);
+  return value & 1 ? value & ~(uint32_t) 0x3 : value & ~(uint32_t) 0xf;
+}
+
+/* Sets COMMAND_BITS, a combination of PCI_CMD_* bits, in the
+   command register of the function at ADDR. */
+void
+pci_enable (struct pci_addr addr, uint16_t command_bits)
+{
+  uint32_t value = pci_read_config (addr, PCI_REG_COMMAND);
+
+  /* Writing 1 to a status bit clears it, so write back only the
+     command half of the register. */
+  pci_write_config (addr, PCI_REG_COMMAND, (value & 0xffff) | command_bits);
+}
+
+/* Returns true if the function with identification register ID
+   has the vendor and device IDs in AUX. */
+static bool
+match_device (struct pci_addr addr UNUSED, uint32_t id,
+              uint32_t class UNUSED, const void *aux)
+{
+  const uint16_t *want = aux;
+  return (id & 0xffff) == want[0] && (id >> 16) == want[1];
+}
+
+/* Finds the first function with the given VENDOR and DEVICE IDs
+   and stores its location in *ADDR.  Returns true if successful,
+   false if there is no such function. */
+bool
+pci_find_device (uint16_t vendor, uint16_t device, struct pci_addr *addr)
+{
+  uint16_t want[2];
+
+  want[0] = vendor;
+  want[1] = device;
+  return find (match_device, want, NULL, addr);
+}
+
+/* Finds the first function after the one at *ADDR, in scan
+   order, with the given VENDOR and DEVICE IDs and stores its
+   location in *ADDR.  Returns true if successful, false if there
+   is no such function.  Together with pci_find_device(), visits
+   every matching function in turn. */
+bool
+pci_find_next_device (uint16_t vendor, uint16_t device, struct pci_addr *addr)
+{
+  struct pci_addr after = *addr;
+  uint16_t want[2];
+
+  want[0] = vendor;
+  want[1] = device;
+  return find (match_device, want, &after, addr);
+}
+
+/* Returns true if the function with class register CLASS has the
+   class and subclass codes in AUX. */
+static bool
+match_class (struct pci_addr addr UNUSED, uint32_t id UNUSED,
+             uint32_t class, const void *aux)
+{
+  const uint8_t *want = aux;
+  return (class >> 24) == want[0] && ((class >> 16) & 0xff) == want[1];
+}
+
+/* Finds the first function with the given CLASS and SUBCLASS
+   codes and stores its location in *ADDR.  Returns true if
+   successful, false if there is no such function. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_addr *addr)
+{
+  uint8_t want[2];
+
+  want[0] = class;
+  want[1] = subclass;
+  return find (match_class, want, NULL, addr);
+}
+
+/* Selects configuration register REG of the function at ADDR. */
+static void
+select_register (struct pci_addr addr, uint8_t reg)
+{
+  ASSERT (addr.dev < 32 && addr.func < 8);
+  ASSERT (reg % 4 == 0);
+
+  outl (CONFIG_ADDRESS, (0x80000000u | (addr.bus << 16) | (addr.dev << 11)
+                         | (addr.func << 8) | reg));
+}
+
+/* Returns ADDR's position in scan order. */
+static int
+scan_index (struct pci_addr addr)
+{
+  return (addr.bus << 8) | (addr.dev << 3) | addr.func;
+}
+
+/* Scans every function on every bus, in order, and stores the
+   location of the first one for which MATCH returns true into
+   *ADDR.  If AFTER is non-null, functions up to and including
+   the one at *AFTER are skipped.  MATCH is passed the function's
+   location, its ID and class registers, and AUX.  Returns true
+   if a function matched, false otherwise. */
+static bool
+find (bool (*match) (struct pci_addr, uint32_t id, uint32_t class,
+                     const void *aux),
+      const void *aux, const struct pci_addr *after, struct pci_addr *addr)
+{
+  int bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func = 0; func < 8; func++)
+        {
+          struct pci_addr a;
+          uint32_t id;
+
+          a.bus = bus;
+          a.dev = dev;
+          a.func = func;
+          id = pci_read_config (a, PCI_REG_ID);
+          if ((id & 0xffff) == NO_VENDOR)
+            {
+              /* No function 0 means no device at all. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          if ((after == NULL || scan_index (a) > scan_index (*after))
+              && match (a, id, pci_read_config (a, PCI_REG_CLASS), aux))
+            {
+              *addr = a;
+              return true;
+            }
+
+          /* Only multi-function devices have functions 1...7. */
+          if (func == 0
+              && (pci_read_config (a, PCI_REG_HEADER) & 0x00800000) == 0)
+            break;
+        }
+  return false;
+}
@@ -0,0 +1,38 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Location of a PCI function in configuration space. */
+struct pci_addr
+  {
+    uint8_t bus;                /* Bus number, 0...255. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Configuration space registers common to all header types. */
+#define PCI_REG_ID 0x00         /* Vendor ID (15:0), device ID (31:16). */
+#define PCI_REG_COMMAND 0x04    /* Command (15:0), status (31:16). */
+#define PCI_REG_CLASS 0x08      /* Revision, prog IF, subclass, class. */
+#define PCI_REG_HEADER 0x0c     /* Header type in bits 23:16. */
+#define PCI_REG_BAR0 0x10       /* First base address register. */
+#define PCI_REG_INTR 0x3c       /* Interrupt line in bits 7:0. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MEMORY 0x0002   /* Respond to memory space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* May act as bus master. */
+
+uint32_t pci_read_config (struct pci_addr, uint8_t reg);
+void pci_write_config (struct pci_addr, uint8_t reg, uint32_t value);
+uint32_t pci_read_bar (struct pci_addr, int bar);
+void pci_enable (struct pci_addr, uint16_t command_bits);
+
+bool pci_find_device (uint16_t vendor, uint16_t device, struct pci_addr *);
+bool pci_find_next_device (uint16_t vendor, uint16_t device,
+                           struct pci_addr *);
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_addr *);
+
+#endif /* devices/pci.h */
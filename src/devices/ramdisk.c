@@ -0,0 +1,111 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a block device whose contents are
+   kept in kernel pool pages.  Its contents do not survive a
+   reboot, so it is mostly useful for benchmarking the file
+   system and VM independent of disk costs, and for scratch data
+   that need not persist. */
+
+/* Number of sectors stored in each page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    size_t page_cnt;            /* Number of pages. */
+    uint8_t **pages;            /* Storage, SECTORS_PER_PAGE per page. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk SIZE sectors long, initially all zeros,
+   and registers it as block device "ram0".  Panics if there is
+   not enough memory. */
+void
+ramdisk_init (block_sector_t size)
+{
+  struct ramdisk *rd;
+  size_t i;
+
+  rd = malloc (sizeof *rd);
+  if (rd == NULL)
+    PANIC ("ram0: out of memory");
+  rd->page_cnt = DIV_ROUND_UP (size, SECTORS_PER_PAGE);
+  rd->pages = malloc (rd->page_cnt * sizeof *rd->pages);
+  if (rd->pages == NULL)
+    PANIC ("ram0: out of memory");
+  for (i = 0; i < rd->page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        PANIC ("ram0: out of memory after %zu of %"PRDSNu" sectors",
+               i * SECTORS_PER_PAGE, size);
+    }
+
+  block_register ("ram0", BLOCK_RAW, "RAM disk", size,
+                  &ramdisk_operations, rd);
+}
+
+/* Returns the address of sector SECTOR of RAM disk RD. */
+static uint8_t *
+sector_addr (const struct ramdisk *rd, block_sector_t sector)
+{
+  return (rd->pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads sector SECTOR from RAM disk RD_ into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_read (void *rd_, block_sector_t sector, void *buffer)
+{
+  memcpy (buffer, sector_addr (rd_, sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes sector SECTOR to RAM disk RD_ from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_write (void *rd_, block_sector_t sector, const void *buffer)
+{
+  memcpy (sector_addr (rd_, sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads the CNT sectors starting at SECTOR from RAM disk RD_ into
+   the buffers described by SG. */
+static void
+ramdisk_read_multiple (void *rd_, block_sector_t sector, block_sector_t cnt,
+                       const struct block_sg *sg)
+{
+  block_sector_t i;
+
+  for (i = 0; i < cnt; i++)
+    ramdisk_read (rd_, sector + i, block_sg_sector (sg, i));
+}
+
+/* Writes the CNT sectors starting at SECTOR to RAM disk RD_ from
+   the buffers described by SG. */
+static void
+ramdisk_write_multiple (void *rd_, block_sector_t sector, block_sector_t cnt,
+                        const struct block_sg *sg)
+{
+  block_sector_t i;
+
+  for (i = 0; i < cnt; i++)
+    ramdisk_write (rd_, sector + i, block_sg_sector (sg, i));
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple,
+    NULL
+  };
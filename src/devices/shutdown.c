@@ -8,10 +8,17 @@
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/syscall.h"
+#include "userprog/syscall-trace.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/ide.h"
+#include "devices/virtio-blk.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/journal.h"
 #endif
 
 /* Keyboard control register port. */
@@ -90,6 +97,9 @@ shutdown_power_off (void)
   const char s[] = "Shutdown";
   const char *p;
 
+#ifdef USERPROG
+  syscall_trace_dump ();
+#endif
 #ifdef FILESYS
   filesys_done ();
 #endif
@@ -122,10 +132,16 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  ide_print_stats ();
+  virtio_blk_print_stats ();
+  dcache_print_stats ();
+  free_map_print_stats ();
+  journal_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  syscall_print_stats ();
 #endif
 }
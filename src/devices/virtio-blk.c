@@ -0,0 +1,483 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a driver for virtio block devices,
+   such as those QEMU provides for "-drive if=virtio", through
+   the legacy virtio PCI interface described in the Virtio PCI
+   Card Specification v0.9.5.
+
+   Each device has a single virtqueue.  The block layer hands
+   the driver batches of requests, which are all placed into the
+   virtqueue before the device is notified, once, and which the
+   device may then carry out in any order. */
+
+/* PCI IDs of a transitional virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio registers, in I/O space at BAR0.  Device
+   configuration follows at offset 0x14, because we do not enable
+   MSI-X. */
+#define reg_features(D) ((D)->io_base + 0x00)       /* Device features. */
+#define reg_guest_features(D) ((D)->io_base + 0x04) /* Driver features. */
+#define reg_queue_pfn(D) ((D)->io_base + 0x08)      /* Queue page frame. */
+#define reg_queue_size(D) ((D)->io_base + 0x0c)     /* Queue size (r/o). */
+#define reg_queue_select(D) ((D)->io_base + 0x0e)   /* Queue select. */
+#define reg_queue_notify(D) ((D)->io_base + 0x10)   /* Queue notify. */
+#define reg_status(D) ((D)->io_base + 0x12)         /* Device status. */
+#define reg_isr(D) ((D)->io_base + 0x13)            /* ISR status (r/o). */
+#define reg_capacity(D) ((D)->io_base + 0x14)       /* Sectors, 64 bits. */
+
+/* Device Status Register bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Guest has noticed the device. */
+#define STATUS_DRIVER 0x02      /* Guest has a driver for it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready to drive it. */
+#define STATUS_FAILED 0x80      /* Driver has given up on it. */
+
+/* ISR Status Register bits.  Reading the register clears it. */
+#define ISR_QUEUE 0x01          /* Used ring was updated. */
+
+/* Virtqueue descriptor: one buffer in a descriptor chain. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address of buffer. */
+    uint32_t len;               /* Length of buffer in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_* bits. */
+    uint16_t next;              /* Next descriptor, with VRING_DESC_F_NEXT. */
+  };
+
+#define VRING_DESC_F_NEXT 1     /* Chain continues at NEXT. */
+#define VRING_DESC_F_WRITE 2    /* Device writes buffer (else reads it). */
+
+/* Descriptor chains the driver has made available to the device. */
+struct vring_avail
+  {
+    uint16_t flags;             /* Unused. */
+    uint16_t idx;               /* Where the driver puts the next entry. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+
+/* Descriptor chain the device has finished with. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of descriptor chain. */
+    uint32_t len;               /* Bytes written into its buffers. */
+  };
+
+/* Descriptor chains the device has finished with. */
+struct vring_used
+  {
+    uint16_t flags;             /* VRING_USED_F_* bits. */
+    uint16_t idx;               /* Where the device puts the next entry. */
+    struct vring_used_elem ring[];
+  };
+
+#define VRING_USED_F_NO_NOTIFY 1        /* Device needs no notification. */
+
+/* Header of a virtio block request, read by the device. */
+struct request_header
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_IN or VIRTIO_BLK_T_OUT. */
+    uint32_t ioprio;            /* Priority, unused. */
+    uint64_t sector;            /* First sector. */
+  };
+
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+#define VIRTIO_BLK_S_OK 0       /* Status of a successful request. */
+
+/* Memory for one request's header and status, which must be in
+   kernel memory where the device can find them. */
+struct slot
+  {
+    struct request_header header;
+    uint8_t status;             /* Written by the device. */
+  };
+
+/* Number of slots, which all fit in a single page. */
+#define SLOT_CNT (PGSIZE / sizeof (struct slot))
+
+/* A virtio block device. */
+struct virtio_blk
+  {
+    struct list_elem elem;      /* Element in devices. */
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base of legacy registers. */
+    uint8_t irq;                /* Interrupt vector. */
+
+    /* Virtqueue, all in one contiguous block of pages. */
+    uint16_t queue_size;        /* Number of descriptors, a power of 2. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    volatile struct vring_used *used;   /* Used ring. */
+    uint16_t used_idx;          /* Next used ring entry to consume. */
+    struct semaphore completed; /* Up'd once per used ring entry. */
+    struct slot *slots;         /* Request headers and statuses. */
+
+    /* Statistics. */
+    long long request_cnt;      /* Requests given to the device. */
+    long long notify_cnt;       /* Notifications sent to it. */
+    long long intr_cnt;         /* Interrupts received from it. */
+  };
+
+/* All virtio block devices. */
+static struct list devices = LIST_INITIALIZER (devices);
+
+/* Which of the 16 legacy interrupt lines have our handler. */
+static bool irq_registered[16];
+
+static struct block_operations virtio_blk_operations;
+
+static void probe (struct pci_addr, const char *name);
+static intr_handler_func interrupt_handler;
+
+/* Finds and initializes every virtio block device, registering
+   each one and its partitions with the block layer. */
+void
+virtio_blk_init (void)
+{
+  struct pci_addr addr;
+  bool found;
+  int dev_cnt = 0;
+
+  for (found = pci_find_device (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, &addr);
+       found && dev_cnt < 26;
+       found = pci_find_next_device (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, &addr))
+    {
+      char name[8];
+
+      snprintf (name, sizeof name, "vd%c", 'a' + dev_cnt++);
+      probe (addr, name);
+    }
+}
+
+/* Prints request, notification, and interrupt counts for each
+   virtio block device.  Requests per notification shows how well
+   batching works. */
+void
+virtio_blk_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&devices); e != list_end (&devices); e = list_next (e))
+    {
+      struct virtio_blk *d = list_entry (e, struct virtio_blk, elem);
+      printf ("%s: %lld requests in %lld notifications, %lld interrupts\n",
+              d->name, d->request_cnt, d->notify_cnt, d->intr_cnt);
+    }
+}
+
+
+/* Device initialization. */
+
+/* Returns the number of pages needed by a legacy virtqueue with
+   QUEUE_SIZE descriptors, and stores the byte offsets of its
+   available and used rings into *AVAIL_OFS and *USED_OFS. */
+static size_t
+queue_pages (uint16_t queue_size, size_t *avail_ofs, size_t *used_ofs)
+{
+  *avail_ofs = queue_size * sizeof (struct vring_desc);
+  *used_ofs = ROUND_UP (*avail_ofs + sizeof (struct vring_avail)
+                        + (queue_size + 1) * sizeof (uint16_t), PGSIZE);
+  return DIV_ROUND_UP (*used_ofs + sizeof (struct vring_used)
+                       + queue_size * sizeof (struct vring_used_elem)
+                       + sizeof (uint16_t), PGSIZE);
+}
+
+/* Sets up the virtqueue of device D.  Returns true if
+   successful, false on failure. */
+static bool
+setup_queue (struct virtio_blk *d)
+{
+  size_t avail_ofs, used_ofs;
+  uint8_t *queue;
+
+  outw (reg_queue_select (d), 0);
+  d->queue_size = inw (reg_queue_size (d));
+  if (d->queue_size < 3 || (d->queue_size & (d->queue_size - 1)) != 0)
+    {
+      printf ("%s: unusable queue size %"PRIu16"\n", d->name, d->queue_size);
+      return false;
+    }
+
+  queue = palloc_get_multiple (PAL_ZERO,
+                               queue_pages (d->queue_size,
+                                            &avail_ofs, &used_ofs));
+  d->slots = palloc_get_page (PAL_ZERO);
+  if (queue == NULL || d->slots == NULL)
+    {
+      printf ("%s: out of memory for virtqueue\n", d->name);
+      palloc_free_multiple (queue, queue_pages (d->queue_size,
+                                                &avail_ofs, &used_ofs));
+      palloc_free_page (d->slots);
+      return false;
+    }
+  d->desc = (struct vring_desc *) queue;
+  d->avail = (struct vring_avail *) (queue + avail_ofs);
+  d->used = (struct vring_used *) (queue + used_ofs);
+  d->used_idx = 0;
+  sema_init (&d->completed, 0);
+
+  outl (reg_queue_pfn (d), vtop (queue) / PGSIZE);
+  return true;
+}
+
+/* Initializes the virtio block device at ADDR and registers it
+   with the block layer as NAME. */
+static void
+probe (struct pci_addr addr, const char *name)
+{
+  struct virtio_blk *d;
+  uint64_t capacity;
+  uint8_t line;
+  char extra_info[32];
+  struct block *block;
+
+  if ((pci_read_config (addr, PCI_REG_BAR0) & 1) == 0)
+    {
+      printf ("%s: no legacy virtio registers, ignoring\n", name);
+      return;
+    }
+  line = pci_read_config (addr, PCI_REG_INTR) & 0xff;
+  if (line >= 16)
+    {
+      printf ("%s: no interrupt line, ignoring\n", name);
+      return;
+    }
+
+  d = malloc (sizeof *d);
+  if (d == NULL)
+    {
+      printf ("%s: out of memory, ignoring\n", name);
+      return;
+    }
+  strlcpy (d->name, name, sizeof d->name);
+  d->io_base = pci_read_bar (addr, 0);
+  d->irq = line + 0x20;
+  d->request_cnt = d->notify_cnt = d->intr_cnt = 0;
+  pci_enable (addr, PCI_CMD_IO | PCI_CMD_MASTER);
+
+  /* Reset the device and tell it we have a driver.  We need none
+     of the optional features it offers. */
+  outb (reg_status (d), 0);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  inl (reg_features (d));
+  outl (reg_guest_features (d), 0);
+
+  if (!setup_queue (d))
+    {
+      outb (reg_status (d), STATUS_FAILED);
+      free (d);
+      return;
+    }
+
+  list_push_back (&devices, &d->elem);
+  if (!irq_registered[line])
+    {
+      intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+      irq_registered[line] = true;
+    }
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+  capacity = (inl (reg_capacity (d))
+              | (uint64_t) inl (reg_capacity (d) + 4) << 32);
+  if (capacity > UINT32_MAX)
+    capacity = UINT32_MAX;
+
+  snprintf (extra_info, sizeof extra_info, "virtio, %"PRIu16"-entry queue",
+            d->queue_size);
+  block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                          &virtio_blk_operations, d);
+  partition_scan (block);
+}
+
+
+/* Request submission. */
+
+/* Appends a descriptor for the SIZE bytes at kernel address
+   BUFFER, with the given FLAGS, to the descriptor chain being
+   built in D's descriptor table, whose next free entry is *NEXT,
+   and advances *NEXT.  If MERGE is true and BUFFER directly
+   follows the previous descriptor's buffer in physical memory,
+   that descriptor is extended instead. */
+static void
+add_desc (struct virtio_blk *d, uint16_t *next, const void *buffer,
+          uint32_t size, uint16_t flags, bool merge)
+{
+  uint64_t addr = vtop (buffer);
+  struct vring_desc *desc;
+
+  flags |= VRING_DESC_F_NEXT;
+  if (merge)
+    {
+      desc = &d->desc[*next - 1];
+      if (desc->flags == flags && desc->addr + desc->len == addr)
+        {
+          desc->len += size;
+          return;
+        }
+    }
+
+  desc = &d->desc[*next];
+  desc->addr = addr;
+  desc->len = size;
+  desc->flags = flags;
+  desc->next = *next + 1;
+  ++*next;
+}
+
+/* Carries out the CNT requests in REQS on virtio block device
+   D_.  The requests are placed into the virtqueue as long as
+   descriptors and slots last, the device is notified once, and
+   then we wait for all of them to complete before starting over
+   with any that did not fit.  A request too big for the
+   remaining descriptors is split into several device requests. */
+static void
+virtio_blk_transfer_batch (void *d_, struct block_request **reqs,
+                           size_t cnt)
+{
+  struct virtio_blk *d = d_;
+  const struct block_sg *sg = cnt > 0 ? reqs[0]->sg : NULL;
+  block_sector_t done = 0;
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      uint16_t next = 0;
+      size_t slot_cnt = 0;
+      size_t j;
+
+      while (i < cnt && slot_cnt < SLOT_CNT && next + 3 <= d->queue_size)
+        {
+          struct block_request *r = reqs[i];
+          struct slot *s = &d->slots[slot_cnt];
+          uint16_t head = next;
+          bool merge = false;
+
+          s->header.type = r->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+          s->header.ioprio = 0;
+          s->header.sector = r->sector + done;
+          s->status = 0xff;
+          add_desc (d, &next, &s->header, sizeof s->header, 0, false);
+
+          /* Data, leaving a descriptor for the status. */
+          while (done < r->cnt && next + 1 < d->queue_size)
+            {
+              block_sector_t n = (sg->cnt < r->cnt - done
+                                  ? sg->cnt : r->cnt - done);
+              add_desc (d, &next, sg->buffer, n * BLOCK_SECTOR_SIZE,
+                        r->write ? 0 : VRING_DESC_F_WRITE, merge);
+              merge = true;
+              done += n;
+              sg++;
+            }
+
+          add_desc (d, &next, &s->status, 1, VRING_DESC_F_WRITE, false);
+          d->desc[next - 1].flags &= ~VRING_DESC_F_NEXT;
+
+          d->avail->ring[(uint16_t) (d->avail->idx + slot_cnt)
+                         % d->queue_size] = head;
+          slot_cnt++;
+          d->request_cnt++;
+
+          if (done == r->cnt)
+            {
+              done = 0;
+              if (++i < cnt)
+                sg = reqs[i]->sg;
+            }
+        }
+
+      /* Make the whole batch available at once, then notify the
+         device unless it has told us not to bother. */
+      barrier ();
+      d->avail->idx += slot_cnt;
+      barrier ();
+      if ((d->used->flags & VRING_USED_F_NO_NOTIFY) == 0)
+        {
+          outw (reg_queue_notify (d), 0);
+          d->notify_cnt++;
+        }
+
+      for (j = 0; j < slot_cnt; j++)
+        sema_down (&d->completed);
+      for (j = 0; j < slot_cnt; j++)
+        if (d->slots[j].status != VIRTIO_BLK_S_OK)
+          PANIC ("%s: %s of sector %"PRIu64" failed (status %"PRIu8")",
+                 d->name,
+                 (d->slots[j].header.type == VIRTIO_BLK_T_OUT
+                  ? "write" : "read"),
+                 d->slots[j].header.sector, d->slots[j].status);
+    }
+}
+
+/* Reads sector SECTOR from virtio block device D_ into BUFFER. */
+static void
+virtio_blk_read (void *d_, block_sector_t sector, void *buffer)
+{
+  struct block_sg sg = { buffer, 1 };
+  struct block_request r;
+  struct block_request *reqs[1] = { &r };
+
+  block_request_init (&r, false, sector, 1, &sg, NULL, NULL);
+  virtio_blk_transfer_batch (d_, reqs, 1);
+}
+
+/* Writes sector SECTOR to virtio block device D_ from BUFFER. */
+static void
+virtio_blk_write (void *d_, block_sector_t sector, const void *buffer)
+{
+  struct block_sg sg = { (void *) buffer, 1 };
+  struct block_request r;
+  struct block_request *reqs[1] = { &r };
+
+  block_request_init (&r, true, sector, 1, &sg, NULL, NULL);
+  virtio_blk_transfer_batch (d_, reqs, 1);
+}
+
+static struct block_operations virtio_blk_operations =
+  {
+    virtio_blk_read,
+    virtio_blk_write,
+    NULL,
+    NULL,
+    virtio_blk_transfer_batch
+  };
+
+/* Interrupt handler for the interrupt line in F, which one or
+   more virtio block devices may share.  Wakes up the waiter once
+   for each request each device has completed. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&devices); e != list_end (&devices); e = list_next (e))
+    {
+      struct virtio_blk *d = list_entry (e, struct virtio_blk, elem);
+      if (d->irq == f->vec_no && (inb (reg_isr (d)) & ISR_QUEUE) != 0)
+        {
+          d->intr_cnt++;
+          while (d->used_idx != d->used->idx)
+            {
+              d->used_idx++;
+              sema_up (&d->completed);
+            }
+        }
+    }
+}
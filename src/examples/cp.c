@@ -1,4 +1,4 @@
-/* cat.c
+/* cp.c
 
 Copies one file to another. */
 
@@ -9,6 +9,7 @@ int
 main (int argc, char *argv[]) 
 {
   int in_fd, out_fd;
+  int size;
 
   if (argc != 3) 
     {
@@ -37,7 +38,19 @@ main (int argc, char *argv[])
       return EXIT_FAILURE;
     }
 
-  /* Copy data. */
+  /* Copy data in the kernel, if it can. */
+  size = filesize (in_fd);
+  while (size > 0) 
+    {
+      int bytes_copied = copy_file_range (in_fd, out_fd, size);
+      if (bytes_copied <= 0)
+        break;
+      size -= bytes_copied;
+    }
+  if (size == 0)
+    return EXIT_SUCCESS;
+
+  /* Otherwise copy the rest through a buffer. */
   for (;;) 
     {
       char buffer[1024];
@@ -5,8 +5,9 @@
    named.
 
    By default, only the name of each file is printed.  If "-l" is
-   given as the first argument, the type, size, and inumber of
-   each file is also printed.  This won't work until project 4. */
+   given as the first argument, the size and inumber of each
+   file is also printed.  Entries are read in batches with
+   getdents(). */
 
 #include <syscall.h>
 #include <stdio.h>
@@ -15,47 +16,55 @@
 static bool
 list_dir (const char *dir, bool verbose) 
 {
+  struct dirent entries[16];
   int dir_fd = open (dir);
+  int size;
+
   if (dir_fd == -1) 
     {
       printf ("%s: not found\n", dir);
       return false;
     }
 
-  if (isdir (dir_fd))
+  size = getdents (dir_fd, entries, sizeof entries);
+  if (size != -1)
     {
-      char name[READDIR_MAX_LEN];
-
-      printf ("%s", dir);
-      if (verbose)
-        printf (" (inumber %d)", inumber (dir_fd));
-      printf (":\n");
+      printf ("%s:\n", dir);
 
-      while (readdir (dir_fd, name)) 
+      /* Read the directory a buffer of entries at a time. */
+      while (size > 0)
         {
-          printf ("%s", name); 
-          if (verbose) 
-            {
-              char full_name[128];
-              int entry_fd;
+          int cnt = size / sizeof *entries;
+          int i;
 
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
+          for (i = 0; i < cnt; i++)
+            {
+              const char *name = entries[i].d_name;
 
-              printf (": ");
-              if (entry_fd != -1)
+              printf ("%s", name); 
+              if (verbose) 
                 {
-                  if (isdir (entry_fd))
-                    printf ("directory");
+                  char full_name[128];
+                  int entry_fd;
+
+                  if (!strcmp (dir, ".") || !strcmp (dir, "/"))
+                    strlcpy (full_name, name, sizeof full_name);
                   else
+                    snprintf (full_name, sizeof full_name, "%s/%s",
+                              dir, name);
+                  entry_fd = open (full_name);
+
+                  printf (": ");
+                  if (entry_fd != -1)
                     printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
+                  else
+                    printf ("open failed");
+                  printf (", inumber %d", entries[i].d_ino);
+                  close (entry_fd);
                 }
-              else
-                printf ("open failed");
-              close (entry_fd);
+              printf ("\n");
             }
-          printf ("\n");
+          size = getdents (dir_fd, entries, sizeof entries);
         }
     }
   else 
@@ -55,6 +55,7 @@ read_line (char line[], size_t size)
   for (;;)
     {
       char c;
+      fflush (stdout);
       read (STDIN_FILENO, &c, 1);
 
       switch (c) 
@@ -0,0 +1,180 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A cached directory entry.
+   Maps a (parent directory inode sector, name) pair to the inode
+   sector the name refers to, or to DCACHE_NEGATIVE if the parent
+   is known not to contain the name. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t parent;              /* Parent directory inode sector. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t sector;              /* Inode sector or DCACHE_NEGATIVE. */
+  };
+
+static struct hash dentries;            /* All cached entries. */
+static struct list lru_list;            /* Most recently used at front. */
+static struct lock dcache_lock;         /* Protects the two above. */
+
+/* Statistics. */
+static long long hit_cnt;               /* # of lookups answered. */
+static long long miss_cnt;              /* # of lookups not in cache. */
+
+static unsigned dentry_hash (const struct hash_elem *, void *aux);
+static bool dentry_less (const struct hash_elem *, const struct hash_elem *,
+                         void *aux);
+static struct dentry *find_dentry (block_sector_t parent, const char *name);
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void)
+{
+  hash_init (&dentries, dentry_hash, dentry_less, NULL);
+  list_init (&lru_list);
+  lock_init (&dcache_lock);
+  hit_cnt = miss_cnt = 0;
+}
+
+/* Looks up NAME in the directory whose inode is in sector PARENT.
+   Returns false if the cache knows nothing about NAME.
+   Otherwise returns true and sets *SECTOR to the inode sector of
+   NAME, or to DCACHE_NEGATIVE if NAME does not exist in PARENT. */
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sector)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find_dentry (parent, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+      *sector = d->sector;
+      hit_cnt++;
+    }
+  else
+    miss_cnt++;
+  lock_release (&dcache_lock);
+
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   PARENT refers to the inode in SECTOR, or, if SECTOR is
+   DCACHE_NEGATIVE, that NAME does not exist.  Evicts the least
+   recently used entry if the cache is full.  Names too long to
+   be valid are not cached. */
+void
+dcache_insert (block_sector_t parent, const char *name,
+               block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find_dentry (parent, name);
+  if (d != NULL)
+    list_remove (&d->lru_elem);
+  else
+    {
+      if (hash_size (&dentries) >= DCACHE_SIZE)
+        {
+          /* Recycle the least recently used entry. */
+          d = list_entry (list_pop_back (&lru_list), struct dentry, lru_elem);
+          hash_delete (&dentries, &d->hash_elem);
+        }
+      else
+        d = malloc (sizeof *d);
+
+      if (d != NULL)
+        {
+          d->parent = parent;
+          strlcpy (d->name, name, sizeof d->name);
+          hash_insert (&dentries, &d->hash_elem);
+        }
+    }
+
+  if (d != NULL)
+    {
+      d->sector = sector;
+      list_push_front (&lru_list, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Drops any cached entry for NAME in the directory whose inode
+   is in sector PARENT. */
+void
+dcache_invalidate (block_sector_t parent, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find_dentry (parent, name);
+  if (d != NULL)
+    {
+      hash_delete (&dentries, &d->hash_elem);
+      list_remove (&d->lru_elem);
+      free (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Prints dentry cache statistics. */
+void
+dcache_print_stats (void)
+{
+  printf ("Dentry cache: %lld hits, %lld misses\n", hit_cnt, miss_cnt);
+}
+
+/* Returns the cached entry for NAME in PARENT, or a null pointer
+   if there is none.  Must be called with dcache_lock held. */
+static struct dentry *
+find_dentry (block_sector_t parent, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Returns a hash value for dentry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->parent);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,22 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Sector stored in a negative entry, i.e. for a name that is
+   known not to exist in its parent directory. */
+#define DCACHE_NEGATIVE ((block_sector_t) -1)
+
+/* Maximum number of entries kept in the dentry cache. */
+#define DCACHE_SIZE 64
+
+void dcache_init (void);
+bool dcache_lookup (block_sector_t parent, const char *name,
+                    block_sector_t *sector);
+void dcache_insert (block_sector_t parent, const char *name,
+                    block_sector_t sector);
+void dcache_invalidate (block_sector_t parent, const char *name);
+void dcache_print_stats (void);
+
+#endif /* filesys/dcache.h */
@@ -2,9 +2,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
@@ -21,6 +23,22 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Number of directory entries dir_read_entries() reads at once. */
+#define READ_BATCH 128
+
+/* Serializes changes to directory entries, so that checking for
+   a name and adding or removing it happen atomically, and so that
+   a name found by dir_lookup() stays valid until its inode is
+   open. */
+static struct lock dir_lock;
+
+/* Initializes the directory module. */
+void
+dir_init (void) 
+{
+  lock_init (&dir_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -37,6 +55,7 @@ dir_open (struct inode *inode)
   struct dir *dir = calloc (1, sizeof *dir);
   if (inode != NULL && dir != NULL)
     {
+      inode_set_metadata (inode);
       dir->inode = inode;
       dir->pos = 0;
       return dir;
@@ -114,20 +133,35 @@ lookup (const struct dir *dir, const char *name,
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   Consults the dentry cache first, and records the outcome of
+   the directory scan there on a miss.  Opens the inode before
+   releasing dir_lock, so that dir_remove() cannot free its sector
+   for reuse in between. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t parent;
+  block_sector_t sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  parent = inode_get_inumber (dir->inode);
+  lock_acquire (&dir_lock);
+  if (!dcache_lookup (parent, name, &sector))
+    {
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : DCACHE_NEGATIVE;
+      dcache_insert (parent, name, sector);
+    }
+
+  if (sector != DCACHE_NEGATIVE)
+    *inode = inode_open (sector);
   else
     *inode = NULL;
+  lock_release (&dir_lock);
 
   return *inode != NULL;
 }
@@ -153,6 +187,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
     return false;
 
   /* Check that NAME is not in use. */
+  lock_acquire (&dir_lock);
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
@@ -172,9 +207,11 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  lock_release (&dir_lock);
   return success;
 }
 
@@ -193,6 +230,7 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
+  lock_acquire (&dir_lock);
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
@@ -202,6 +240,7 @@ dir_remove (struct dir *dir, const char *name)
     goto done;
 
   /* Erase directory entry. */
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
@@ -211,6 +250,7 @@ dir_remove (struct dir *dir, const char *name)
   success = true;
 
  done:
+  lock_release (&dir_lock);
   inode_close (inode);
   return success;
 }
@@ -222,15 +262,66 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool success = false;
 
+  lock_acquire (&dir_lock);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          success = true;
+          break;
         } 
     }
-  return false;
+  lock_release (&dir_lock);
+  return success;
+}
+
+/* Reads the entries in use in the directory stored in INODE,
+   starting at byte offset *POS, into ENTRIES, which has room for
+   MAX of them, and advances *POS past the entries consumed.
+   Unlike dir_readdir(), which reads the directory one entry at a
+   time, this reads entries in batches of several sectors, and it
+   returns each entry's inode sector along with its name.  Returns
+   the number of entries stored, which is 0 at the end of the
+   directory, or if memory is short. */
+size_t
+dir_read_entries (struct inode *inode, off_t *pos, struct dirent *entries,
+                  size_t max)
+{
+  struct dir_entry *batch;
+  size_t cnt = 0;
+
+  batch = malloc (READ_BATCH * sizeof *batch);
+  if (batch == NULL)
+    return 0;
+
+  lock_acquire (&dir_lock);
+  while (cnt < max)
+    {
+      off_t bytes = inode_read_at (inode, batch, READ_BATCH * sizeof *batch,
+                                   *pos);
+      size_t batch_cnt = bytes / sizeof *batch;
+      size_t i;
+
+      for (i = 0; i < batch_cnt && cnt < max; i++)
+        {
+          if (batch[i].in_use)
+            {
+              entries[cnt].d_ino = batch[i].inode_sector;
+              strlcpy (entries[cnt].d_name, batch[i].name,
+                       sizeof entries[cnt].d_name);
+              cnt++;
+            }
+          *pos += sizeof *batch;
+        }
+      if (batch_cnt < READ_BATCH)
+        break;
+    }
+  lock_release (&dir_lock);
+
+  free (batch);
+  return cnt;
 }
@@ -2,9 +2,11 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
 
 /* Partition that contains the file system. */
@@ -22,7 +24,10 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  dir_init ();
+  dcache_init ();
   free_map_init ();
+  journal_init (format, free_map_sector_cnt ());
 
   if (format) 
     do_format ();
@@ -36,6 +41,7 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  journal_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,14 +52,20 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_root ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  free_map_flush ();
+  journal_end ();
 
   return success;
 }
@@ -62,7 +74,9 @@ filesys_create (const char *name, off_t initial_size)
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   or if an internal memory allocation fails.
+   NAME may also be "/" or ".", which open the root directory
+   itself, so that it can be listed with dir_read_entries(). */
 struct file *
 filesys_open (const char *name)
 {
@@ -70,7 +84,12 @@ filesys_open (const char *name)
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    {
+      if (!strcmp (name, "/") || !strcmp (name, "."))
+        inode = inode_reopen (dir_get_inode (dir));
+      else
+        dir_lookup (dir, name, &inode);
+    }
   dir_close (dir);
 
   return file_open (inode);
@@ -83,9 +102,15 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_root ();
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  free_map_flush ();
+  journal_end ();
 
   return success;
 }
@@ -99,5 +124,6 @@ do_format (void)
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
+  journal_flush ();
   printf ("done.\n");
 }
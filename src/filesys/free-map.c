@@ -1,52 +1,183 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdio.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+
+/* Number of free map bits stored in one sector of its file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Protects free_map and its file. */
+
+/* Sectors of the free map file whose contents changed since they
+   were last written, one bit per sector of the file. */
+static struct bitmap *dirty_sectors;
+
+/* Number of free map file sectors written back. */
+static long long write_cnt;
 
-/* Initializes the free map. */
+static void mark_dirty (block_sector_t sector, size_t cnt);
+
+/* Initializes the free map.  The journal can log only so many
+   free map sectors in one batch, so on a disk larger than a free
+   map of JOURNAL_FREE_MAP_MAX sectors covers, the file system
+   uses only the sectors it does cover. */
 void
 free_map_init (void) 
 {
-  free_map = bitmap_create (block_size (fs_device));
+  block_sector_t size = block_size (fs_device);
+
+  if (size > JOURNAL_FREE_MAP_MAX * BITS_PER_SECTOR)
+    {
+      size = JOURNAL_FREE_MAP_MAX * BITS_PER_SECTOR;
+      printf ("filesys: using only the first %"PRDSNu" of %"PRDSNu
+              " sectors\n", size, block_size (fs_device));
+    }
+
+  lock_init (&free_map_lock);
+  free_map = bitmap_create (size);
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  dirty_sectors = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                               BLOCK_SECTOR_SIZE));
+  if (dirty_sectors == NULL)
+    PANIC ("dirty sector bitmap creation failed");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.
+   The change reaches the disk at the next free_map_flush(). */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
-    {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
-    }
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
+    mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates the longest run of consecutive free sectors, up to
+   CNT of them, and stores the first into *SECTORP.  A run of all
+   CNT sectors is taken from the lowest address that has one.
+   Returns the number of sectors allocated, 0 if none are free.
+   The change reaches the disk at the next free_map_flush(). */
+size_t
+free_map_allocate_best (size_t cnt, block_sector_t *sectorp)
+{
+  size_t best_start = 0, best_cnt = 0;
+  size_t sector;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
+    {
+      best_start = sector;
+      best_cnt = cnt;
+    }
+  else
+    {
+      /* No run is CNT sectors long, so find the longest. */
+      size_t size = bitmap_size (free_map);
+      size_t start = 0;
+
+      while (start < size)
+        {
+          size_t end;
+
+          start = bitmap_scan (free_map, start, 1, false);
+          if (start == BITMAP_ERROR)
+            break;
+          for (end = start; end < size && !bitmap_test (free_map, end); end++)
+            continue;
+          if (end - start > best_cnt)
+            {
+              best_start = start;
+              best_cnt = end - start;
+            }
+          start = end;
+        }
+      bitmap_set_multiple (free_map, best_start, best_cnt, true);
+    }
+  mark_dirty (best_start, best_cnt);
+  lock_release (&free_map_lock);
+  if (best_cnt > 0)
+    *sectorp = best_start;
+  return best_cnt;
+}
+
+/* Allocates the CNT consecutive sectors starting at SECTOR, if
+   they are all free.  Returns true if successful, false if any of
+   them is in use or lies past the end of the device.
+   The change reaches the disk at the next free_map_flush(). */
+bool
+free_map_allocate_at (block_sector_t sector, size_t cnt)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = (sector < bitmap_size (free_map)
+             && cnt <= bitmap_size (free_map) - sector
+             && bitmap_none (free_map, sector, cnt));
+  if (success)
+    {
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      mark_dirty (sector, cnt);
+    }
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use.
+   The change reaches the disk at the next free_map_flush(). */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the sectors of the free map file that changed since
+   they were last written.  Called at file system sync points. */
+void
+free_map_flush (void) 
+{
+  size_t idx;
+
+  lock_acquire (&free_map_lock);
+  if (free_map_file != NULL)
+    for (idx = 0; idx < bitmap_size (dirty_sectors); idx++)
+      if (bitmap_test (dirty_sectors, idx))
+        {
+          if (!bitmap_write_range (free_map, free_map_file,
+                                   idx * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+            PANIC ("can't write free map");
+          bitmap_reset (dirty_sectors, idx);
+          write_cnt++;
+        }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,15 +187,19 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_metadata (file_get_inode (free_map_file));
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  bitmap_set_all (dirty_sectors, false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  free_map_flush ();
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -80,6 +215,37 @@ free_map_create (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_metadata (file_get_inode (free_map_file));
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_sectors, false);
+}
+
+/* Returns the number of sectors in the free map file. */
+size_t
+free_map_sector_cnt (void)
+{
+  return bitmap_size (dirty_sectors);
+}
+
+/* Prints free map statistics. */
+void
+free_map_print_stats (void) 
+{
+  printf ("Free map: %lld sectors written\n", write_cnt);
+}
+
+/* Marks the free map file sectors holding the bits for CNT
+   sectors starting at SECTOR as dirty.
+   Must be called with free_map_lock held. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first, last;
+
+  if (cnt == 0)
+    return;
+  first = sector / BITS_PER_SECTOR;
+  last = (sector + cnt - 1) / BITS_PER_SECTOR;
+  bitmap_set_multiple (dirty_sectors, first, last - first + 1, true);
 }
@@ -1,9 +1,11 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "devices/block.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -16,15 +18,20 @@ void
 fsutil_ls (char **argv UNUSED) 
 {
   struct dir *dir;
-  char name[NAME_MAX + 1];
+  struct dirent entries[16];
+  off_t pos = 0;
+  size_t cnt, i;
   
   printf ("Files in the root directory:\n");
   dir = dir_open_root ();
   if (dir == NULL)
     PANIC ("root dir open failed");
-  while (dir_readdir (dir, name))
-    printf ("%s\n", name);
+  while ((cnt = dir_read_entries (dir_get_inode (dir), &pos, entries,
+                                  sizeof entries / sizeof *entries)) > 0)
+    for (i = 0; i < cnt; i++)
+      printf ("%s\n", entries[i].d_name);
   printf ("End of listing.\n");
+  dir_close (dir);
 }
 
 /* Prints the contents of file ARGV[1] to the system console as
@@ -66,6 +73,38 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Writes block device request statistics in CSV format to new
+   file ARGV[1], which may then be copied out of the VM with the
+   `pintos' -g option. */
+void
+fsutil_iostats (char **argv) 
+{
+  const char *file_name = argv[1];
+  struct file *file;
+  char *buffer;
+  size_t size;
+
+  printf ("Writing I/O statistics to '%s'...\n", file_name);
+
+  /* Take the snapshot before the file system adds traffic of its
+     own. */
+  size = block_stats_csv (NULL, 0) + 1;
+  buffer = malloc (size);
+  if (buffer == NULL)
+    PANIC ("couldn't allocate buffer");
+  size = block_stats_csv (buffer, size);
+
+  if (!filesys_create (file_name, size))
+    PANIC ("%s: create failed", file_name);
+  file = filesys_open (file_name);
+  if (file == NULL)
+    PANIC ("%s: open failed", file_name);
+  if (file_write (file, buffer, size) != (off_t) size)
+    PANIC ("%s: write failed", file_name);
+  file_close (file);
+  free (buffer);
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
    device into the Pintos file system. */
 void
@@ -154,6 +193,24 @@ fsutil_extract (char **argv UNUSED)
   free (header);
 }
 
+/* Next sector to write in the ustar archive on the scratch
+   device, shared by fsutil_append() and fsutil_append_buffer(). */
+static block_sector_t append_sector;
+
+/* Writes a ustar end-of-archive marker, which is two consecutive
+   sectors full of zeros, at the current position on scratch
+   device DST, using BUFFER as a sector of scratch space.  Doesn't
+   advance the position past them, in case more files are
+   appended. */
+static void
+append_end (struct block *dst, void *buffer)
+{
+  memset (buffer, 0, BLOCK_SECTOR_SIZE);
+  block_write (dst, append_sector, buffer);
+  if (append_sector + 1 < block_size (dst))
+    block_write (dst, append_sector + 1, buffer);
+}
+
 /* Copies file FILE_NAME from the file system to the scratch
    device, in ustar format.
 
@@ -165,8 +222,6 @@ fsutil_extract (char **argv UNUSED)
 void
 fsutil_append (char **argv)
 {
-  static block_sector_t sector = 0;
-
   const char *file_name = argv[1];
   void *buffer;
   struct file *src;
@@ -194,29 +249,72 @@ fsutil_append (char **argv)
   /* Write ustar header to first sector. */
   if (!ustar_make_header (file_name, USTAR_REGULAR, size, buffer))
     PANIC ("%s: name too long for ustar format", file_name);
-  block_write (dst, sector++, buffer);
+  block_write (dst, append_sector++, buffer);
 
   /* Do copy. */
   while (size > 0) 
     {
       int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
+      if (append_sector >= block_size (dst))
         PANIC ("%s: out of space on scratch device", file_name);
       if (file_read (src, buffer, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
       memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
+      block_write (dst, append_sector++, buffer);
       size -= chunk_size;
     }
-
-  /* Write ustar end-of-archive marker, which is two consecutive
-     sectors full of zeros.  Don't advance our position past
-     them, though, in case we have more files to append. */
-  memset (buffer, 0, BLOCK_SECTOR_SIZE);
-  block_write (dst, sector, buffer);
-  block_write (dst, sector, buffer + 1);
+  append_end (dst, buffer);
 
   /* Finish up. */
   file_close (src);
   free (buffer);
 }
+
+/* Appends the SIZE bytes in DATA to the ustar archive on the
+   scratch device as file FILE_NAME, after any files already
+   appended by fsutil_append().  Unlike fsutil_append(), which
+   runs as an action, this may be called at shutdown, so it
+   reports failure instead of panicking. */
+void
+fsutil_append_buffer (const char *file_name, const void *data, size_t size)
+{
+  const uint8_t *p = data;
+  struct block *dst;
+  void *buffer;
+
+  dst = block_get_role (BLOCK_SCRATCH);
+  if (dst == NULL)
+    {
+      printf ("%s: no scratch device\n", file_name);
+      return;
+    }
+  if (append_sector + DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE) + 2
+      > block_size (dst))
+    {
+      printf ("%s: out of space on scratch device\n", file_name);
+      return;
+    }
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL || !ustar_make_header (file_name, USTAR_REGULAR, size,
+                                            buffer))
+    {
+      printf ("%s: couldn't write ustar header\n", file_name);
+      free (buffer);
+      return;
+    }
+
+  printf ("Appending '%s' to ustar archive on scratch device...\n",
+          file_name);
+  block_write (dst, append_sector++, buffer);
+  while (size > 0)
+    {
+      size_t chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
+      memcpy (buffer, p, chunk_size);
+      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
+      block_write (dst, append_sector++, buffer);
+      p += chunk_size;
+      size -= chunk_size;
+    }
+  append_end (dst, buffer);
+  free (buffer);
+}
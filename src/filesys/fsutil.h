@@ -1,10 +1,14 @@
 #ifndef FILESYS_FSUTIL_H
 #define FILESYS_FSUTIL_H
 
+#include <stddef.h>
+
 void fsutil_ls (char **argv);
 void fsutil_cat (char **argv);
 void fsutil_rm (char **argv);
 void fsutil_extract (char **argv);
 void fsutil_append (char **argv);
+void fsutil_append_buffer (const char *file_name, const void *, size_t);
+void fsutil_iostats (char **argv);
 
 #endif /* filesys/fsutil.h */
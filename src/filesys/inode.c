@@ -1,23 +1,66 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Most sectors zeroed by a single request. */
+#define ZERO_RUN_SECTORS 32
+
+/* Stands for the disk sector of a file sector in a hole. */
+#define NO_SECTOR ((block_sector_t) -1)
+
+/* A run of file sectors stored in consecutive disk sectors.
+   Only the first INIT_CNT of them have been written.  The rest
+   were reserved by inode_fallocate() and read as zeros until
+   written, without being zeroed on disk in advance. */
+struct extent
+  {
+    block_sector_t file_sector;         /* First sector within file. */
+    block_sector_t disk_sector;         /* First sector on disk. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    block_sector_t init_cnt;            /* Number initialized. */
+  };
+
+/* Space in an inode sector after its header, which holds either
+   the file's extents or, for a file of at most INLINE_MAX bytes,
+   the file's contents. */
+#define INLINE_MAX (BLOCK_SECTOR_SIZE - 4 * sizeof (uint32_t))
+
+/* Number of extents that fit in an inode sector.  A file
+   fragmented into more runs than that cannot grow further; writes
+   that would need another extent come up short, and fallocate
+   fails. */
+#define EXTENT_CNT (INLINE_MAX / sizeof (struct extent))
+
+/* Inode flags. */
+#define INODE_INLINE 0x1                /* Contents in u.data. */
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   A file of at most INLINE_MAX bytes is stored inline, in the
+   inode sector itself, until it grows larger.  Otherwise file
+   sectors that no extent covers are holes, which read as zeros
+   and take no disk space until they are written. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t flags;                     /* INODE_* flags. */
+    uint32_t extent_cnt;                /* Number of extents in use. */
+    union
+      {
+        struct extent extents[EXTENT_CNT];  /* Extents, by file_sector. */
+        uint8_t data[INLINE_MAX];           /* Inline file contents. */
+      } u;
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -31,37 +74,291 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
+    bool loading;                       /* Still being read from disk? */
+    struct lock lock;                   /* Protects the members below. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rwlock;               /* Protects data and file contents. */
+    bool metadata;                      /* Contents written via journal? */
     struct inode_disk data;             /* Inode content. */
   };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+/* Finds file sector IDX among the extents of DISK.  If it is
+   allocated, returns the disk sector that holds it, stores into
+   *INIT whether it is initialized, and stores into *CNT the
+   number of sectors from there on that are likewise initialized
+   or not within its extent.  If it lies in a hole, returns
+   NO_SECTOR, sets *INIT to false, and stores into *CNT the
+   number of sectors up to the next extent, or NO_SECTOR if no
+   extent follows. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+lookup (const struct inode_disk *disk, block_sector_t idx,
+        block_sector_t *cnt, bool *init)
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  size_t i;
+
+  *init = false;
+  for (i = 0; i < disk->extent_cnt; i++)
+    {
+      const struct extent *e = &disk->u.extents[i];
+      block_sector_t ofs = idx - e->file_sector;
+
+      if (idx < e->file_sector)
+        {
+          *cnt = e->file_sector - idx;
+          return NO_SECTOR;
+        }
+      if (ofs < e->cnt)
+        {
+          *init = ofs < e->init_cnt;
+          *cnt = *init ? e->init_cnt - ofs : e->cnt - ofs;
+          return e->disk_sector + ofs;
+        }
+    }
+  *cnt = NO_SECTOR;
+  return NO_SECTOR;
+}
+
+/* Returns true if extent B directly follows extent A, both in
+   the file and on disk, and the two can be merged without an
+   uninitialized sector coming before an initialized one. */
+static bool
+can_merge (const struct extent *a, const struct extent *b)
+{
+  return (a->file_sector + a->cnt == b->file_sector
+          && a->disk_sector + a->cnt == b->disk_sector
+          && (a->init_cnt == a->cnt || b->init_cnt == 0));
+}
+
+/* Merges extent B into extent A, which must pass can_merge(). */
+static void
+merge (struct extent *a, const struct extent *b)
+{
+  if (a->init_cnt == a->cnt)
+    a->init_cnt += b->init_cnt;
+  a->cnt += b->cnt;
+}
+
+/* Allocates disk sectors for up to CNT file sectors of DISK
+   starting at file sector IDX, which must begin a hole at least
+   CNT sectors long, and records them in DISK's extents as
+   initialized if INIT is true, otherwise as uninitialized.
+   Prefers the disk sectors that directly follow those of the
+   preceding file sector, so that a file written in order stays
+   in a single extent, and otherwise takes the longest free run
+   available.  Returns the number of sectors allocated, or 0 if
+   the disk is full or DISK has no extent to spare. */
+static block_sector_t
+allocate (struct inode_disk *disk, block_sector_t idx, block_sector_t cnt,
+          bool init)
+{
+  struct extent *prev, *next, new;
+  size_t i;
+
+  /* Find the extents just before and just after the hole. */
+  for (i = 0; i < disk->extent_cnt; i++)
+    if (disk->u.extents[i].file_sector > idx)
+      break;
+  prev = i > 0 ? &disk->u.extents[i - 1] : NULL;
+  next = i < disk->extent_cnt ? &disk->u.extents[i] : NULL;
+
+  new.file_sector = idx;
+  if (prev != NULL && prev->file_sector + prev->cnt == idx
+      && free_map_allocate_at (prev->disk_sector + prev->cnt, cnt))
+    new.disk_sector = prev->disk_sector + prev->cnt;
+  else
+    {
+      cnt = free_map_allocate_best (cnt, &new.disk_sector);
+      if (cnt == 0)
+        return 0;
+    }
+  new.cnt = cnt;
+  new.init_cnt = init ? cnt : 0;
+
+  /* Record the run, merging it with its neighbors if possible. */
+  if (prev != NULL && can_merge (prev, &new))
+    {
+      merge (prev, &new);
+      if (next != NULL && can_merge (prev, next))
+        {
+          merge (prev, next);
+          disk->extent_cnt--;
+          memmove (next, next + 1, (disk->extent_cnt - i) * sizeof *next);
+        }
+    }
+  else if (next != NULL && can_merge (&new, next))
+    {
+      merge (&new, next);
+      *next = new;
+    }
+  else if (disk->extent_cnt < EXTENT_CNT)
+    {
+      struct extent *e = &disk->u.extents[i];
+
+      memmove (e + 1, e, (disk->extent_cnt - i) * sizeof *e);
+      disk->extent_cnt++;
+      *e = new;
+    }
+  else
+    {
+      free_map_release (new.disk_sector, cnt);
+      return 0;
+    }
+  return cnt;
+}
+
+/* Open inodes, keyed on sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Protects open_inodes and the open_cnt and loading members of
+   every open inode. */
+static struct lock open_inodes_lock;
+
+/* Broadcast when an inode in open_inodes finishes loading. */
+static struct condition inode_loaded;
+
+static unsigned inode_hash (const struct hash_elem *, void *aux);
+static bool inode_less (const struct hash_elem *, const struct hash_elem *,
+                        void *aux);
+
+/* Reads SECTOR into BUFFER.  If METADATA is true, the sector may
+   have a newer image in the journal, which is used instead. */
+static void
+read_sector (block_sector_t sector, void *buffer, bool metadata)
+{
+  if (!metadata || !journal_read (sector, buffer))
+    block_read (fs_device, sector, buffer);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR into
+   BUFFER, as read_sector() does.  Data sectors are read in a
+   single block layer request. */
+static void
+read_sectors (block_sector_t sector, block_sector_t cnt, void *buffer,
+              bool metadata)
+{
+  if (metadata)
+    {
+      block_sector_t i;
+
+      for (i = 0; i < cnt; i++)
+        read_sector (sector + i, (uint8_t *) buffer + i * BLOCK_SECTOR_SIZE,
+                     true);
+    }
+  else
+    {
+      struct block_sg sg = { buffer, cnt };
+      block_read_multiple (fs_device, sector, cnt, &sg);
+    }
+}
+
+/* Writes BUFFER to SECTOR.  If METADATA is true, the write goes
+   through the journal.  Otherwise it goes straight to disk, after
+   dropping any journaled image of a sector that used to hold
+   metadata. */
+static void
+write_sector (block_sector_t sector, const void *buffer, bool metadata)
+{
+  if (metadata)
+    journal_write (sector, buffer);
   else
-    return -1;
+    {
+      journal_revoke (sector);
+      block_write (fs_device, sector, buffer);
+    }
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Writes BUFFER to the CNT consecutive sectors starting at
+   SECTOR, as write_sector() does.  Data sectors are written in a
+   single block layer request. */
+static void
+write_sectors (block_sector_t sector, block_sector_t cnt, const void *buffer,
+               bool metadata)
+{
+  block_sector_t i;
+
+  if (metadata)
+    for (i = 0; i < cnt; i++)
+      journal_write (sector + i,
+                     (const uint8_t *) buffer + i * BLOCK_SECTOR_SIZE);
+  else
+    {
+      struct block_sg sg = { (void *) buffer, cnt };
+
+      for (i = 0; i < cnt; i++)
+        journal_revoke (sector + i);
+      block_write_multiple (fs_device, sector, cnt, &sg);
+    }
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_loaded);
+}
+
+/* Writes zeros to the CNT sectors starting at SECTOR.  Every
+   element of the scatter-gather list points to the same sector
+   of zeros, so up to ZERO_RUN_SECTORS sectors go in each
+   request. */
+static void
+zero_sectors (block_sector_t sector, block_sector_t cnt)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  struct block_sg sg[ZERO_RUN_SECTORS];
+  block_sector_t i;
+
+  for (i = 0; i < ZERO_RUN_SECTORS; i++)
+    {
+      sg[i].buffer = zeros;
+      sg[i].cnt = 1;
+    }
+
+  while (cnt > 0)
+    {
+      block_sector_t run = cnt < ZERO_RUN_SECTORS ? cnt : ZERO_RUN_SECTORS;
+
+      for (i = 0; i < run; i++)
+        journal_revoke (sector + i);
+      block_write_multiple (fs_device, sector, run, sg);
+      sector += run;
+      cnt -= run;
+    }
+}
+
+/* Marks the CNT file sectors of DISK starting at file sector
+   IDX, which must be uninitialized sectors of a single extent,
+   as initialized, in preparation for writing them.  Any
+   uninitialized sectors of the extent that come before them are
+   zeroed on disk first, since they will no longer read as zeros
+   otherwise.  Only one initialized prefix is tracked per extent,
+   so this zeroing is synchronous and can be long: the first write
+   near the end of a large reserved extent first writes zeros to
+   nearly all of it.  Files filled front to back never pay it. */
+static void
+initialize (struct inode_disk *disk, block_sector_t idx, block_sector_t cnt)
+{
+  struct extent *e;
+
+  for (e = disk->u.extents; e < disk->u.extents + disk->extent_cnt; e++)
+    if (idx - e->file_sector < e->cnt)
+      {
+        block_sector_t ofs = idx - e->file_sector;
+
+        ASSERT (ofs >= e->init_cnt && cnt <= e->cnt - ofs);
+        if (ofs > e->init_cnt)
+          zero_sectors (e->disk_sector + e->init_cnt, ofs - e->init_cnt);
+        e->init_cnt = ofs + cnt;
+        return;
+      }
+  NOT_REACHED ();
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -85,19 +382,26 @@ inode_create (block_sector_t sector, off_t length)
   if (disk_inode != NULL)
     {
       size_t sectors = bytes_to_sectors (length);
+      block_sector_t start;
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      if (length <= (off_t) INLINE_MAX)
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          /* Small enough to live in the inode, already all zeros. */
+          disk_inode->flags = INODE_INLINE;
+          write_sector (sector, disk_inode, true);
+          success = true;
+        }
+      else if (free_map_allocate (sectors, &start))
+        {
+          disk_inode->extent_cnt = 1;
+          disk_inode->u.extents[0].file_sector = 0;
+          disk_inode->u.extents[0].disk_sector = start;
+          disk_inode->u.extents[0].cnt = sectors;
+          disk_inode->u.extents[0].init_cnt = sectors;
+          write_sector (sector, disk_inode, true);
+          zero_sectors (start, sectors);
           success = true; 
         } 
       free (disk_inode);
@@ -111,42 +415,81 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&open_inodes_lock);
+
+  /* Check whether this inode is already open.  If another thread
+     is still reading it from disk, wait for that to finish. */
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      while (inode->loading)
+        cond_wait (&inode_loaded, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
+      return inode; 
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize, and insert the inode marked as loading, so that
+     the disk read below does not hold up opens of other inodes.
+     Concurrent openers of the same sector wait until it is
+     loaded. */
   inode->sector = sector;
   inode->open_cnt = 1;
+  inode->loading = true;
+  lock_init (&inode->lock);
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  rwlock_init (&inode->rwlock);
+  inode->metadata = false;
+  hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  read_sector (inode->sector, &inode->data, true);
+
+  lock_acquire (&open_inodes_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
+/* Marks INODE as holding file system metadata, such as a
+   directory or the free map, so that writes to its contents go
+   through the journal. */
+void
+inode_set_metadata (struct inode *inode)
+{
+  if (inode->metadata)
+    return;
+  rwlock_acquire_write (&inode->rwlock);
+  inode->metadata = true;
+  rwlock_release_write (&inode->rwlock);
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -159,26 +502,42 @@ inode_get_inumber (const struct inode *inode)
 
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If INODE was also a removed inode, frees its blocks, in a
+   journal transaction of their own unless the caller already has
+   one open. */
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* Drop our reference.  Once the inode has left open_inodes, a
+     concurrent inode_open() of the same sector reads a fresh copy
+     instead of reviving this one. */
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          const struct extent *e;
+
+          journal_begin ();
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          for (e = inode->data.u.extents;
+               e < inode->data.u.extents + inode->data.extent_cnt; e++)
+            free_map_release (e->disk_sector, e->cnt);
+          free_map_flush ();
+          journal_end ();
         }
 
       free (inode); 
@@ -191,7 +550,9 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode->lock);
   inode->removed = true;
+  lock_release (&inode->lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -204,14 +565,32 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rwlock);
+  if (inode->data.flags & INODE_INLINE)
+    {
+      /* The contents of an inline file are already in memory. */
+      if (offset < inode->data.length)
+        {
+          bytes_read = (size < inode->data.length - offset
+                        ? size : inode->data.length - offset);
+          memcpy (buffer, inode->data.u.data + offset, bytes_read);
+        }
+      goto done;
+    }
+
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Disk sector to read, starting byte offset within sector,
+         and sectors left like it in its extent or hole. */
+      block_sector_t run;
+      bool init;
+      block_sector_t sector_idx = lookup (&inode->data,
+                                          offset / BLOCK_SECTOR_SIZE,
+                                          &run, &init);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = inode->data.length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -220,10 +599,28 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (!init)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          /* A hole or uninitialized sectors read as zeros, all the
+             way to their end, without any disk I/O. */
+          off_t n = size < inode_left ? size : inode_left;
+          if (run != NO_SECTOR
+              && (long long) run * BLOCK_SECTOR_SIZE - sector_ofs < n)
+            n = run * BLOCK_SECTOR_SIZE - sector_ofs;
+          memset (buffer + bytes_read, 0, n);
+          chunk_size = n;
+        }
+      else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+        {
+          /* Read full sectors directly into caller's buffer, every
+             one left in this extent in a single request. */
+          off_t want = size < inode_left ? size : inode_left;
+          block_sector_t cnt = want / BLOCK_SECTOR_SIZE;
+          if (cnt > run)
+            cnt = run;
+          read_sectors (sector_idx, cnt, buffer + bytes_read,
+                        inode->metadata);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
@@ -235,7 +632,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
               if (bounce == NULL)
                 break;
             }
-          block_read (fs_device, sector_idx, bounce);
+          read_sector (sector_idx, bounce, inode->metadata);
           memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
         }
       
@@ -244,16 +641,73 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
+
+ done:
+  rwlock_release_read (&inode->rwlock);
   free (bounce);
 
   return bytes_read;
 }
 
+/* Starts a journal transaction to cover changes to INODE's
+   on-disk inode and to the free map, unless *IN_TXN says one is
+   already open.  Metadata inodes are only written by callers
+   that already have a transaction open, so for them nothing is
+   done. */
+static void
+begin_change (const struct inode *inode, bool *in_txn)
+{
+  if (!*in_txn && !inode->metadata)
+    {
+      journal_begin ();
+      *in_txn = true;
+    }
+}
+
+/* Moves the contents of INODE, which must be inline, out to a
+   newly allocated data sector, so that INODE can grow beyond
+   INLINE_MAX bytes.  Returns true if successful, false if memory
+   or disk allocation fails, in which case INODE is unchanged. */
+static bool
+promote (struct inode *inode)
+{
+  struct inode_disk *disk = &inode->data;
+  uint8_t *contents;
+  bool success = false;
+
+  ASSERT (disk->flags & INODE_INLINE);
+
+  contents = calloc (1, BLOCK_SECTOR_SIZE);
+  if (contents == NULL)
+    return false;
+  memcpy (contents, disk->u.data, INLINE_MAX);
+
+  disk->flags &= ~INODE_INLINE;
+  memset (&disk->u, 0, sizeof disk->u);
+  if (disk->length == 0)
+    success = true;
+  else if (allocate (disk, 0, 1, true) == 1)
+    {
+      write_sector (disk->u.extents[0].disk_sector, contents, inode->metadata);
+      success = true;
+    }
+  else
+    {
+      disk->flags |= INODE_INLINE;
+      memcpy (disk->u.data, contents, INLINE_MAX);
+    }
+  free (contents);
+  return success;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs.
+   Writing past end of file extends INODE.  Disk sectors are
+   allocated only for the sectors actually written, so seeking
+   past end of file and writing leaves a hole in between.  An
+   inline file that would grow past INLINE_MAX bytes first moves
+   its contents out to a data sector. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
@@ -261,33 +715,87 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
   uint8_t *bounce = NULL;
+  bool in_txn = false;          /* Opened a journal transaction? */
+  bool dirty = false;           /* Changed inode->data? */
+  bool denied;
+
+  /* Check for denial while holding the rwlock, which
+     inode_deny_write() also takes, so that no write is still in
+     progress once writes have been denied. */
+  rwlock_acquire_write (&inode->rwlock);
+  lock_acquire (&inode->lock);
+  denied = inode->deny_write_cnt > 0;
+  lock_release (&inode->lock);
+  if (denied)
+    {
+      rwlock_release_write (&inode->rwlock);
+      return 0;
+    }
 
-  if (inode->deny_write_cnt)
-    return 0;
+  if (inode->data.flags & INODE_INLINE)
+    {
+      begin_change (inode, &in_txn);
+      dirty = true;
+      if (size <= (off_t) INLINE_MAX && offset <= (off_t) INLINE_MAX - size)
+        {
+          /* Still small enough to stay inline.  Any gap between
+             the old end of file and OFFSET is already zeros. */
+          memcpy (inode->data.u.data + offset, buffer, size);
+          bytes_written = size;
+          offset += size;
+          size = 0;
+        }
+      else if (!promote (inode))
+        size = 0;
+    }
 
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Sector to write, starting byte offset within sector, and
+         sectors left like it in its extent or hole. */
+      block_sector_t idx = offset / BLOCK_SECTOR_SIZE;
+      block_sector_t run;
+      bool init;
+      block_sector_t sector_idx = lookup (&inode->data, idx, &run, &init);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in sector. */
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+      int chunk_size = size < sector_left ? size : sector_left;
 
       if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          /* Write full sectors directly to disk, as many as fit in
+             this extent in one request, as in inode_read_at().  In
+             a hole, allocate them first. */
+          block_sector_t cnt = size / BLOCK_SECTOR_SIZE;
+          if (cnt > run)
+            cnt = run;
+          if (sector_idx == NO_SECTOR)
+            {
+              begin_change (inode, &in_txn);
+              cnt = allocate (&inode->data, idx, cnt, true);
+              if (cnt == 0)
+                break;
+              dirty = true;
+              sector_idx = lookup (&inode->data, idx, &run, &init);
+            }
+          else if (!init)
+            {
+              begin_change (inode, &in_txn);
+              initialize (&inode->data, idx, cnt);
+              dirty = true;
+            }
+          write_sectors (sector_idx, cnt, buffer + bytes_written,
+                         inode->metadata);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
+          bool fresh = false;
+
           /* We need a bounce buffer. */
           if (bounce == NULL) 
             {
@@ -296,15 +804,33 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 break;
             }
 
+          /* A sector in a hole needs allocating, and its old
+             contents are all zeros, as are those of a sector not
+             yet initialized. */
+          if (sector_idx == NO_SECTOR)
+            {
+              begin_change (inode, &in_txn);
+              if (allocate (&inode->data, idx, 1, true) == 0)
+                break;
+              dirty = fresh = true;
+              sector_idx = lookup (&inode->data, idx, &run, &init);
+            }
+          else if (!init)
+            {
+              begin_change (inode, &in_txn);
+              initialize (&inode->data, idx, 1);
+              dirty = fresh = true;
+            }
+
           /* If the sector contains data before or after the chunk
              we're writing, then we need to read in the sector
              first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
+          if (!fresh && (sector_ofs > 0 || chunk_size < sector_left))
+            read_sector (sector_idx, bounce, inode->metadata);
           else
             memset (bounce, 0, BLOCK_SECTOR_SIZE);
           memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          write_sector (sector_idx, bounce, inode->metadata);
         }
 
       /* Advance. */
@@ -312,18 +838,109 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
+
+  /* Extend the file and write back its inode if it changed. */
+  if (offset > inode->data.length)
+    {
+      begin_change (inode, &in_txn);
+      inode->data.length = offset;
+      dirty = true;
+    }
+  if (dirty)
+    write_sector (inode->sector, &inode->data, true);
+  if (in_txn)
+    {
+      free_map_flush ();
+      journal_end ();
+    }
+  rwlock_release_write (&inode->rwlock);
   free (bounce);
 
   return bytes_written;
 }
 
+/* Reserves disk sectors for the LEN bytes of INODE starting at
+   OFFSET, so that later writes to them need no allocation, and
+   extends INODE to OFFSET + LEN bytes if it is shorter.  Newly
+   reserved sectors are left uninitialized on disk and read as
+   zeros.  Sectors are taken from as few free runs as possible.
+   Returns true if successful, false if writes to INODE are
+   denied or the disk or INODE's extents fill up, in which case
+   some of the range may have been reserved anyway. */
+bool
+inode_fallocate (struct inode *inode, off_t offset, off_t len)
+{
+  block_sector_t idx, end;
+  bool in_txn = false;
+  bool success = true;
+  bool denied;
+
+  if (offset < 0 || len <= 0 || offset > INT32_MAX - len)
+    return false;
+
+  /* As in inode_write_at(), check for denial under the rwlock. */
+  rwlock_acquire_write (&inode->rwlock);
+  lock_acquire (&inode->lock);
+  denied = inode->deny_write_cnt > 0;
+  lock_release (&inode->lock);
+  if (denied)
+    {
+      rwlock_release_write (&inode->rwlock);
+      return false;
+    }
+
+  begin_change (inode, &in_txn);
+  if ((inode->data.flags & INODE_INLINE)
+      && offset + len > (off_t) INLINE_MAX && !promote (inode))
+    success = false;
+
+  if (!(inode->data.flags & INODE_INLINE))
+    {
+      idx = offset / BLOCK_SECTOR_SIZE;
+      end = bytes_to_sectors (offset + len);
+      while (success && idx < end)
+        {
+          block_sector_t run;
+          bool init;
+
+          if (lookup (&inode->data, idx, &run, &init) == NO_SECTOR)
+            {
+              if (run > end - idx)
+                run = end - idx;
+              run = allocate (&inode->data, idx, run, false);
+              if (run == 0)
+                success = false;
+            }
+          idx += run;
+        }
+    }
+
+  if (success && offset + len > inode->data.length)
+    inode->data.length = offset + len;
+  write_sector (inode->sector, &inode->data, true);
+  if (in_txn)
+    {
+      free_map_flush ();
+      journal_end ();
+    }
+  rwlock_release_write (&inode->rwlock);
+
+  return success;
+}
+
 /* Disables writes to INODE.
-   May be called at most once per inode opener. */
+   May be called at most once per inode opener.
+   Waits for any write already in progress to finish, so that
+   INODE's contents do not change once this returns. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +949,39 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
-inode_length (const struct inode *inode)
+inode_length (struct inode *inode)
+{
+  off_t length;
+
+  rwlock_acquire_read (&inode->rwlock);
+  length = inode->data.length;
+  rwlock_release_read (&inode->rwlock);
+  return length;
+}
+
+/* Returns a hash value for inode E, based on its sector. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
 {
-  return inode->data.length;
+  const struct inode *a = hash_entry (a_, struct inode, elem);
+  const struct inode *b = hash_entry (b_, struct inode, elem);
+  return a->sector < b->sector;
 }
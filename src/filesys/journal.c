@@ -0,0 +1,528 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* The code in this file is a write-ahead journal for file system
+   metadata: inode sectors, directory contents and the free map.
+
+   Metadata writes are not sent to their home sectors directly.
+   journal_write() keeps the new sector image in memory as part of
+   the running batch, and reads of the sector are served from that
+   image.  Callers bracket each multi-sector update with
+   journal_begin() and journal_end().  Once enough transactions
+   have accumulated and none is open, the whole batch is
+   committed as one sequential run of sectors in the log: a
+   descriptor naming the home sectors, their images, and a commit
+   record.  Committed images are checkpointed, that is, written
+   to their home sectors, only when the log runs out of space or
+   the file system is flushed.
+
+   After a crash, journal_init() replays every complete record in
+   the log, so either all or none of the writes in a batch reach
+   their home sectors. */
+
+/* Magic numbers identifying journal sectors. */
+#define JOURNAL_MAGIC 0x4c4e524a        /* Journal header. */
+#define DESC_MAGIC 0x4353454a           /* Record descriptor. */
+#define COMMIT_MAGIC 0x544d434a         /* Record commit. */
+
+/* Number of home sectors a descriptor can list, which is the
+   most sectors a single commit may log. */
+#define DESC_CNT JOURNAL_BATCH_SECTORS
+
+/* A batch is committed once it holds this many transactions... */
+#define GROUP_TXN_CNT 16
+
+/* ...or this many sectors. */
+#define GROUP_SECTOR_CNT 64
+
+/* First sector of the log. */
+#define LOG_START (JOURNAL_SECTOR + 1)
+
+/* On-disk journal header, in JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Sequence number of first record. */
+    uint32_t unused[126];               /* Not used. */
+  };
+
+/* On-disk record descriptor, the first sector of a record.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_desc
+  {
+    unsigned magic;                     /* DESC_MAGIC. */
+    uint32_t seq;                       /* Record sequence number. */
+    uint32_t cnt;                       /* Number of logged sectors. */
+    block_sector_t home[DESC_CNT];      /* Home of each logged sector. */
+  };
+
+/* On-disk commit record, the last sector of a record.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_commit
+  {
+    unsigned magic;                     /* COMMIT_MAGIC. */
+    uint32_t seq;                       /* Record sequence number. */
+    uint32_t cnt;                       /* Number of logged sectors. */
+    uint32_t unused[125];               /* Not used. */
+  };
+
+/* In-memory image of a metadata sector. */
+struct journal_block
+  {
+    struct hash_elem elem;              /* Element in running or committed. */
+    block_sector_t sector;              /* Home sector. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+    struct block_sg sg;                 /* Describes DATA for REQUEST. */
+    struct block_request request;       /* Checkpoint write. */
+  };
+
+static struct hash running;             /* Images not yet committed. */
+static struct hash committed;           /* Committed, not checkpointed. */
+static struct lock journal_lock;        /* Protects all journal state. */
+static struct condition batch_done;     /* Signaled after each commit
+                                           and transaction end. */
+static int open_cnt;                    /* Number of open transactions. */
+static int flush_cnt;                   /* Threads waiting to flush. */
+static size_t free_map_sectors;         /* Sectors in the free map. */
+static int batch_txn_cnt;               /* Transactions in running batch. */
+static uint32_t first_seq;              /* Sequence number in header. */
+static uint32_t next_seq;               /* Sequence number of next record. */
+static block_sector_t log_used;         /* Log sectors in use. */
+
+/* Statistics. */
+static long long txn_cnt;               /* # of transactions. */
+static long long commit_cnt;            /* # of commits. */
+static long long logged_cnt;            /* # of sectors logged. */
+static long long checkpoint_cnt;        /* # of checkpoints. */
+
+static unsigned journal_block_hash (const struct hash_elem *, void *aux);
+static bool journal_block_less (const struct hash_elem *,
+                                const struct hash_elem *, void *aux);
+static void free_journal_block (struct hash_elem *, void *aux);
+static struct journal_block *find_block (struct hash *, block_sector_t);
+static void write_header (void);
+static int replay (void);
+static bool has_room (void);
+static void commit (void);
+static void checkpoint (void);
+
+/* Initializes the journal for a file system whose free map
+   occupies FREE_MAP_CNT sectors, at most JOURNAL_FREE_MAP_MAX.
+   If FORMAT is true, writes an empty journal to disk, otherwise
+   replays any records left in the log by an unclean shutdown. */
+void
+journal_init (bool format, size_t free_map_cnt)
+{
+  ASSERT (sizeof (struct journal_header) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_desc) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_commit) == BLOCK_SECTOR_SIZE);
+  ASSERT (DESC_CNT + 2 <= JOURNAL_LOG_SECTORS);
+  ASSERT (free_map_cnt <= JOURNAL_FREE_MAP_MAX);
+
+  hash_init (&running, journal_block_hash, journal_block_less, NULL);
+  hash_init (&committed, journal_block_hash, journal_block_less, NULL);
+  lock_init (&journal_lock);
+  cond_init (&batch_done);
+  open_cnt = batch_txn_cnt = flush_cnt = 0;
+  free_map_sectors = free_map_cnt;
+  log_used = 0;
+
+  if (format)
+    {
+      first_seq = next_seq = 1;
+      write_header ();
+    }
+  else
+    {
+      int replayed = replay ();
+      if (replayed > 0)
+        printf ("journal: replayed %d records\n", replayed);
+    }
+}
+
+/* Commits the running batch and checkpoints everything in the
+   log, leaving all metadata in its home sectors.  Waits for open
+   transactions to end first, so that none is committed half
+   done, and holds off new ones meanwhile. */
+void
+journal_flush (void)
+{
+  lock_acquire (&journal_lock);
+  flush_cnt++;
+  while (open_cnt > 0)
+    cond_wait (&batch_done, &journal_lock);
+  commit ();
+  checkpoint ();
+  flush_cnt--;
+  cond_broadcast (&batch_done, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Starts a transaction.  All journal_write() calls up to the
+   matching journal_end() reach the disk atomically.  A
+   transaction may write at most JOURNAL_TXN_SECTORS sectors
+   besides the free map's.  Waits while the running batch is full
+   or lacks room for that many more sectors from this and every
+   other open transaction, committing it first if none is open.
+   A transaction begun while the current thread already has one
+   open joins the outer transaction. */
+void
+journal_begin (void)
+{
+  if (thread_current ()->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (flush_cnt > 0 || hash_size (&running) >= GROUP_SECTOR_CNT
+         || !has_room ())
+    {
+      if (open_cnt == 0 && flush_cnt == 0)
+        commit ();
+      else
+        cond_wait (&batch_done, &journal_lock);
+    }
+  open_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Ends a transaction started by journal_begin().  Commits the
+   running batch if it is large enough and no other transaction
+   is still open.  Ending a nested transaction does nothing until
+   the outermost one ends. */
+void
+journal_end (void)
+{
+  ASSERT (thread_current ()->journal_depth > 0);
+  if (--thread_current ()->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  ASSERT (open_cnt > 0);
+  open_cnt--;
+  batch_txn_cnt++;
+  txn_cnt++;
+  if (open_cnt == 0 && flush_cnt == 0
+      && (batch_txn_cnt >= GROUP_TXN_CNT
+          || hash_size (&running) >= GROUP_SECTOR_CNT))
+    commit ();
+  cond_broadcast (&batch_done, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Records BUFFER, which must contain BLOCK_SECTOR_SIZE bytes, as
+   the new contents of metadata sector SECTOR. */
+void
+journal_write (block_sector_t sector, const void *buffer)
+{
+  struct journal_block *b;
+
+  lock_acquire (&journal_lock);
+  b = find_block (&running, sector);
+  if (b == NULL)
+    {
+      b = malloc (sizeof *b);
+      if (b == NULL)
+        PANIC ("out of memory for journal block");
+      b->sector = sector;
+      hash_insert (&running, &b->elem);
+    }
+  memcpy (b->data, buffer, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+}
+
+/* If the journal holds an image of SECTOR that has not yet been
+   checkpointed, copies it into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes, and returns true.  Otherwise returns
+   false and the caller should read the sector from disk. */
+bool
+journal_read (block_sector_t sector, void *buffer)
+{
+  struct journal_block *b;
+
+  lock_acquire (&journal_lock);
+  b = find_block (&running, sector);
+  if (b == NULL)
+    b = find_block (&committed, sector);
+  if (b != NULL)
+    memcpy (buffer, b->data, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+
+  return b != NULL;
+}
+
+/* Forgets any image of SECTOR, which is about to be written
+   directly as file data.  If the image was already committed,
+   checkpoints the log first so that a later replay cannot
+   overwrite the new data with stale metadata. */
+void
+journal_revoke (block_sector_t sector)
+{
+  struct journal_block *b;
+
+  lock_acquire (&journal_lock);
+  b = find_block (&running, sector);
+  if (b != NULL)
+    {
+      hash_delete (&running, &b->elem);
+      free (b);
+    }
+  if (find_block (&committed, sector) != NULL)
+    checkpoint ();
+  lock_release (&journal_lock);
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void)
+{
+  printf ("Journal: %lld transactions, %lld commits, "
+          "%lld sectors logged, %lld checkpoints\n",
+          txn_cnt, commit_cnt, logged_cnt, checkpoint_cnt);
+}
+
+/* Returns true if the running batch has room for another
+   transaction, on the assumption that each open transaction and
+   the new one write JOURNAL_TXN_SECTORS more sectors and that
+   between them they flush the whole free map.
+   Must be called with journal_lock held. */
+static bool
+has_room (void)
+{
+  return (hash_size (&running) + free_map_sectors
+          + (open_cnt + 1) * JOURNAL_TXN_SECTORS <= DESC_CNT);
+}
+
+/* Writes the running batch to the log as a single record and
+   moves its images to the committed set.
+   Must be called with journal_lock held. */
+static void
+commit (void)
+{
+  struct journal_block **blocks;
+  struct journal_desc *desc;
+  struct journal_commit *rec;
+  struct block_sg *sg;
+  struct hash_iterator i;
+  size_t cnt, idx;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+
+  cnt = hash_size (&running);
+  if (cnt == 0)
+    return;
+  ASSERT (cnt <= DESC_CNT && cnt + 2 <= JOURNAL_LOG_SECTORS);
+  if (log_used + cnt + 2 > JOURNAL_LOG_SECTORS)
+    checkpoint ();
+
+  blocks = malloc (cnt * sizeof *blocks);
+  sg = malloc ((cnt + 2) * sizeof *sg);
+  desc = calloc (1, sizeof *desc);
+  rec = calloc (1, sizeof *rec);
+  if (blocks == NULL || sg == NULL || desc == NULL || rec == NULL)
+    PANIC ("out of memory for journal commit");
+
+  /* Build the descriptor. */
+  desc->magic = DESC_MAGIC;
+  desc->seq = next_seq;
+  desc->cnt = cnt;
+  idx = 0;
+  hash_first (&i, &running);
+  while (hash_next (&i))
+    {
+      blocks[idx] = hash_entry (hash_cur (&i), struct journal_block, elem);
+      desc->home[idx] = blocks[idx]->sector;
+      idx++;
+    }
+
+  /* Write descriptor and images as one sequential request, then
+     the commit record.  The commit record goes last, so a record
+     is complete on disk only if every sector before it is. */
+  sg[0].buffer = desc;
+  sg[0].cnt = 1;
+  for (idx = 0; idx < cnt; idx++)
+    {
+      sg[idx + 1].buffer = blocks[idx]->data;
+      sg[idx + 1].cnt = 1;
+    }
+  block_write_multiple (fs_device, LOG_START + log_used, cnt + 1, sg);
+  rec->magic = COMMIT_MAGIC;
+  rec->seq = next_seq;
+  rec->cnt = cnt;
+  block_write (fs_device, LOG_START + log_used + 1 + cnt, rec);
+  log_used += cnt + 2;
+  next_seq++;
+
+  /* Committed images replace older committed images. */
+  hash_clear (&running, NULL);
+  for (idx = 0; idx < cnt; idx++)
+    {
+      struct hash_elem *old = hash_replace (&committed, &blocks[idx]->elem);
+      if (old != NULL)
+        free_journal_block (old, NULL);
+    }
+
+  batch_txn_cnt = 0;
+  commit_cnt++;
+  logged_cnt += cnt;
+  cond_broadcast (&batch_done, &journal_lock);
+
+  free (rec);
+  free (desc);
+  free (sg);
+  free (blocks);
+}
+
+/* Writes every committed image to its home sector and empties
+   the log.
+   Must be called with journal_lock held. */
+static void
+checkpoint (void)
+{
+  struct hash_iterator i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+
+  /* Queue every home sector write before waiting for any, so
+     that the device can sort and merge them. */
+  hash_first (&i, &committed);
+  while (hash_next (&i))
+    {
+      struct journal_block *b = hash_entry (hash_cur (&i),
+                                            struct journal_block, elem);
+      b->sg.buffer = b->data;
+      b->sg.cnt = 1;
+      block_request_init (&b->request, true, b->sector, 1, &b->sg,
+                          NULL, NULL);
+      block_submit (fs_device, &b->request);
+    }
+  hash_first (&i, &committed);
+  while (hash_next (&i))
+    block_wait (&hash_entry (hash_cur (&i), struct journal_block,
+                             elem)->request);
+  hash_clear (&committed, free_journal_block);
+
+  /* Only now may the records in the log be discarded. */
+  first_seq = next_seq;
+  log_used = 0;
+  write_header ();
+  checkpoint_cnt++;
+}
+
+/* Writes the journal header, which marks every record in the
+   log with a sequence number below first_seq as obsolete. */
+static void
+write_header (void)
+{
+  struct journal_header *h = calloc (1, sizeof *h);
+  if (h == NULL)
+    PANIC ("out of memory for journal header");
+  h->magic = JOURNAL_MAGIC;
+  h->seq = first_seq;
+  block_write (fs_device, JOURNAL_SECTOR, h);
+  free (h);
+}
+
+/* Reads the journal header and copies every complete record in
+   the log to its home sectors, then empties the log.  Returns
+   the number of records replayed. */
+static int
+replay (void)
+{
+  struct journal_header *h;
+  struct journal_desc *desc;
+  struct journal_commit *rec;
+  uint8_t *data;
+  block_sector_t pos = 0;
+  uint32_t seq;
+  int replayed = 0;
+
+  h = malloc (sizeof *h);
+  desc = malloc (sizeof *desc);
+  rec = malloc (sizeof *rec);
+  data = malloc (BLOCK_SECTOR_SIZE);
+  if (h == NULL || desc == NULL || rec == NULL || data == NULL)
+    PANIC ("out of memory for journal replay");
+
+  block_read (fs_device, JOURNAL_SECTOR, h);
+  if (h->magic != JOURNAL_MAGIC)
+    PANIC ("file system has no journal--reformat with -f");
+  seq = h->seq;
+
+  while (pos + 2 <= JOURNAL_LOG_SECTORS)
+    {
+      size_t idx;
+
+      block_read (fs_device, LOG_START + pos, desc);
+      if (desc->magic != DESC_MAGIC || desc->seq != seq
+          || desc->cnt > DESC_CNT || pos + desc->cnt + 2 > JOURNAL_LOG_SECTORS)
+        break;
+      block_read (fs_device, LOG_START + pos + 1 + desc->cnt, rec);
+      if (rec->magic != COMMIT_MAGIC || rec->seq != seq
+          || rec->cnt != desc->cnt)
+        break;
+
+      for (idx = 0; idx < desc->cnt; idx++)
+        {
+          block_read (fs_device, LOG_START + pos + 1 + idx, data);
+          block_write (fs_device, desc->home[idx], data);
+        }
+      pos += desc->cnt + 2;
+      seq++;
+      replayed++;
+    }
+
+  first_seq = next_seq = seq;
+  write_header ();
+
+  free (data);
+  free (rec);
+  free (desc);
+  free (h);
+  return replayed;
+}
+
+/* Returns the image of SECTOR in hash H, or a null pointer if
+   there is none. */
+static struct journal_block *
+find_block (struct hash *h, block_sector_t sector)
+{
+  struct journal_block key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (h, &key.elem);
+  return e != NULL ? hash_entry (e, struct journal_block, elem) : NULL;
+}
+
+/* Returns a hash value for journal block E. */
+static unsigned
+journal_block_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct journal_block *b = hash_entry (e, struct journal_block, elem);
+  return hash_int (b->sector);
+}
+
+/* Returns true if journal block A's sector precedes B's. */
+static bool
+journal_block_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                    void *aux UNUSED)
+{
+  const struct journal_block *a = hash_entry (a_, struct journal_block, elem);
+  const struct journal_block *b = hash_entry (b_, struct journal_block, elem);
+  return a->sector < b->sector;
+}
+
+/* Frees journal block E. */
+static void
+free_journal_block (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct journal_block, elem));
+}
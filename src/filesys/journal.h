@@ -0,0 +1,43 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of sectors in the on-disk log, which follows the
+   journal header sector (JOURNAL_SECTOR). */
+#define JOURNAL_LOG_SECTORS 128
+
+/* Total number of sectors reserved for the journal. */
+#define JOURNAL_SECTORS (1 + JOURNAL_LOG_SECTORS)
+
+/* Most sectors a single commit can log. */
+#define JOURNAL_BATCH_SECTORS 125
+
+/* Most sectors, other than those of the free map, that a single
+   transaction may write.  Creating a file, the largest
+   transaction, writes the new inode and up to two directory
+   sectors, and may grow the directory, which rewrites its inode
+   and may move its contents out of the inode sector. */
+#define JOURNAL_TXN_SECTORS 8
+
+/* Most free map sectors the journal can handle.  Any transaction
+   may flush the whole free map, so a batch must have room for all
+   of it plus one transaction. */
+#define JOURNAL_FREE_MAP_MAX (JOURNAL_BATCH_SECTORS - JOURNAL_TXN_SECTORS)
+
+void journal_init (bool format, size_t free_map_cnt);
+void journal_flush (void);
+
+/* Transactions. */
+void journal_begin (void);
+void journal_end (void);
+
+/* Sector access. */
+void journal_write (block_sector_t, const void *);
+bool journal_read (block_sector_t, void *);
+void journal_revoke (block_sector_t);
+
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
@@ -1,14 +1,15 @@
 #include <stdio.h>
-#include <string.h>
 #include <syscall.h>
 #include <syscall-nr.h>
 
 /* The standard vprintf() function,
-   which is like printf() but uses a va_list. */
+   which is like printf() but uses a va_list.
+   Output goes through the stdout stream, so by default it is
+   written a line at a time. */
 int
 vprintf (const char *format, va_list args) 
 {
-  return vhprintf (STDOUT_FILENO, format, args);
+  return vfprintf (stdout, format, args);
 }
 
 /* Like printf(), but writes output to the given HANDLE. */
@@ -30,8 +31,8 @@ hprintf (int handle, const char *format, ...)
 int
 puts (const char *s) 
 {
-  write (STDOUT_FILENO, s, strlen (s));
-  putchar ('\n');
+  if (fputs (s, stdout) == EOF || fputc ('\n', stdout) == EOF)
+    return EOF;
 
   return 0;
 }
@@ -40,9 +41,7 @@ puts (const char *s)
 int
 putchar (int c) 
 {
-  char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
-  return c;
+  return fputc (c, stdout);
 }
 
 /* Auxiliary data for vhprintf_helper(). */
@@ -59,11 +58,16 @@ static void flush (struct vhprintf_aux *);
 
 /* Formats the printf() format specification FORMAT with
    arguments given in ARGS and writes the output to the given
-   HANDLE. */
+   HANDLE.  Output to STDOUT_FILENO goes through the stdout
+   stream, so that it stays in order with printf(). */
 int
 vhprintf (int handle, const char *format, va_list args) 
 {
   struct vhprintf_aux aux;
+
+  if (handle == STDOUT_FILENO)
+    return vfprintf (stdout, format, args);
+
   aux.p = aux.buf;
   aux.char_cnt = 0;
   aux.handle = handle;
@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Stream flags. */
+#define F_READ  0x01            /* Open for reading. */
+#define F_WRITE 0x02            /* Open for writing. */
+#define F_EOF   0x04            /* End of file was reached. */
+#define F_ERR   0x08            /* A read or write failed. */
+
+/* A buffered stream.
+
+   The buffer holds either output not yet written or input not
+   yet consumed, never both: switching between reading and
+   writing flushes the stream first. */
+struct __FILE
+  {
+    int fd;                     /* File descriptor. */
+    int flags;                  /* F_* flags, 0 if slot is free. */
+    int mode;                   /* _IOFBF, _IOLBF, or _IONBF. */
+    char *buf;                  /* Buffer. */
+    size_t size;                /* Size of buffer. */
+    size_t out_cnt;             /* Bytes of output in BUF. */
+    size_t in_ofs;              /* Offset of next input byte in BUF. */
+    size_t in_cnt;              /* Bytes of input in BUF. */
+  };
+
+/* Default buffers, one per stream.  Pintos user programs have no
+   heap, so the streams and their buffers are allocated
+   statically. */
+static char buffers[FOPEN_MAX][BUFSIZ];
+
+/* All the streams.  The first is stdout; the rest are free until
+   fopen() or fdopen() claims them. */
+static FILE streams[FOPEN_MAX] =
+  {
+    { STDOUT_FILENO, F_WRITE, _IOLBF, buffers[0], BUFSIZ, 0, 0, 0 },
+  };
+
+FILE *stdout = &streams[0];
+
+/* Returns a free stream, or a null pointer if all of them are in
+   use. */
+static FILE *
+find_free_stream (void)
+{
+  int i;
+
+  for (i = 0; i < FOPEN_MAX; i++)
+    if (streams[i].flags == 0)
+      return &streams[i];
+  return NULL;
+}
+
+/* Sets up STREAM, which must be free, as a fully buffered stream
+   on FD with the given FLAGS, and returns it. */
+static FILE *
+init_stream (FILE *stream, int fd, int flags)
+{
+  stream->fd = fd;
+  stream->flags = flags;
+  stream->mode = _IOFBF;
+  stream->buf = buffers[stream - streams];
+  stream->size = BUFSIZ;
+  stream->out_cnt = 0;
+  stream->in_ofs = stream->in_cnt = 0;
+  return stream;
+}
+
+/* Returns the F_READ and F_WRITE flags for fopen() MODE "r",
+   "w", or "a", optionally followed by "+" (and a "b", which is
+   ignored), or 0 if MODE is invalid. */
+static int
+parse_mode (const char *mode)
+{
+  int flags;
+
+  switch (mode[0])
+    {
+    case 'r':
+      flags = F_READ;
+      break;
+    case 'w':
+    case 'a':
+      flags = F_WRITE;
+      break;
+    default:
+      return 0;
+    }
+  if (strchr (mode + 1, '+') != NULL)
+    flags = F_READ | F_WRITE;
+  return flags;
+}
+
+/* Opens the file called NAME and returns a fully buffered stream
+   for it, or a null pointer on failure.  MODE "r" opens an
+   existing file for reading, "w" replaces any file called NAME
+   with an empty one and opens it for writing, and "a" opens a
+   file for writing at its end, creating it if necessary.  A "+"
+   in MODE opens the file for both reading and writing.
+
+   Pintos has no way to truncate a file, so "w" removes and
+   recreates it, and no way to append atomically, so "a" only
+   seeks to the end of the file once, when it is opened. */
+FILE *
+fopen (const char *name, const char *mode)
+{
+  int flags = parse_mode (mode);
+  FILE *stream = find_free_stream ();
+  int fd;
+
+  if (flags == 0 || stream == NULL)
+    return NULL;
+
+  if (mode[0] == 'w')
+    {
+      remove (name);
+      if (!create (name, 0))
+        return NULL;
+    }
+  else if (mode[0] == 'a')
+    create (name, 0);
+
+  fd = open (name);
+  if (fd < 0)
+    return NULL;
+  if (mode[0] == 'a')
+    seek (fd, filesize (fd));
+
+  return init_stream (stream, fd, flags);
+}
+
+/* Returns a fully buffered stream for file descriptor FD, which
+   must already be open, or a null pointer on failure.  MODE is as
+   for fopen(), but the file is not created, replaced, or
+   repositioned. */
+FILE *
+fdopen (int fd, const char *mode)
+{
+  int flags = parse_mode (mode);
+  FILE *stream = find_free_stream ();
+
+  if (flags == 0 || stream == NULL)
+    return NULL;
+  return init_stream (stream, fd, flags);
+}
+
+/* Flushes STREAM and frees it, closing its file descriptor
+   unless it is the console's.  stdout is only flushed, never
+   freed, since printf() and friends keep writing to it.  Returns
+   0 if successful, EOF if buffered output could not be written. */
+int
+fclose (FILE *stream)
+{
+  int retval = fflush (stream);
+
+  if (stream == stdout)
+    return retval;
+  if (stream->fd > STDOUT_FILENO)
+    close (stream->fd);
+  stream->flags = 0;
+  return retval;
+}
+
+/* Writes any output buffered in STREAM to its file.  If STREAM
+   instead holds input that has not been consumed, moves the file
+   position back over it and discards it, so that the file
+   position matches what the program has read.  If STREAM is a
+   null pointer, flushes every open stream.  Returns 0 if
+   successful, EOF on failure. */
+int
+fflush (FILE *stream)
+{
+  if (stream == NULL)
+    {
+      int retval = 0;
+      int i;
+
+      for (i = 0; i < FOPEN_MAX; i++)
+        if (streams[i].flags != 0 && fflush (&streams[i]) == EOF)
+          retval = EOF;
+      return retval;
+    }
+
+  if (stream->out_cnt > 0)
+    {
+      int cnt = write (stream->fd, stream->buf, stream->out_cnt);
+      bool ok = cnt == (int) stream->out_cnt;
+
+      stream->out_cnt = 0;
+      if (!ok)
+        {
+          stream->flags |= F_ERR;
+          return EOF;
+        }
+    }
+  else if (stream->in_ofs < stream->in_cnt && stream->fd > STDOUT_FILENO)
+    seek (stream->fd, tell (stream->fd) - (stream->in_cnt - stream->in_ofs));
+  stream->in_ofs = stream->in_cnt = 0;
+  return 0;
+}
+
+/* Sets STREAM's buffering MODE, one of _IOFBF, _IOLBF, or
+   _IONBF, after flushing it.  If BUF is nonnull and SIZE is
+   nonzero, STREAM uses the SIZE bytes at BUF as its buffer from
+   now on, otherwise it keeps its current buffer.  Returns 0 if
+   successful, nonzero if MODE is invalid or STREAM could not be
+   flushed. */
+int
+setvbuf (FILE *stream, char *buf, int mode, size_t size)
+{
+  if ((mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+      || fflush (stream) == EOF)
+    return EOF;
+
+  if (buf != NULL && size > 0)
+    {
+      stream->buf = buf;
+      stream->size = size;
+    }
+  stream->mode = mode;
+  return 0;
+}
+
+/* Reads up to CNT elements of SIZE bytes each from STREAM into
+   BUFFER.  Small reads are satisfied from STREAM's buffer, which
+   is refilled a buffer's worth at a time; reads at least as large
+   as the buffer go straight to the file.  Returns the number of
+   whole elements read, which is less than CNT at end of file or
+   on error. */
+size_t
+fread (void *buffer, size_t size, size_t cnt, FILE *stream)
+{
+  char *dst = buffer;
+  size_t length = size * cnt;
+  size_t copied = 0;
+
+  if (length == 0)
+    return 0;
+  if (!(stream->flags & F_READ)
+      || (stream->out_cnt > 0 && fflush (stream) == EOF))
+    {
+      stream->flags |= F_ERR;
+      return 0;
+    }
+
+  while (copied < length)
+    {
+      size_t left = length - copied;
+      int n;
+
+      if (stream->in_ofs < stream->in_cnt)
+        {
+          /* Copy out buffered input. */
+          n = stream->in_cnt - stream->in_ofs;
+          if ((size_t) n > left)
+            n = left;
+          memcpy (dst + copied, stream->buf + stream->in_ofs, n);
+          stream->in_ofs += n;
+          copied += n;
+          continue;
+        }
+
+      if (stream->mode == _IONBF || left >= stream->size)
+        {
+          /* Read straight into the caller's buffer. */
+          n = read (stream->fd, dst + copied, left);
+          if (n > 0)
+            copied += n;
+        }
+      else
+        {
+          /* Refill the buffer. */
+          n = read (stream->fd, stream->buf, stream->size);
+          if (n > 0)
+            {
+              stream->in_ofs = 0;
+              stream->in_cnt = n;
+            }
+        }
+
+      if (n <= 0)
+        {
+          stream->flags |= n == 0 ? F_EOF : F_ERR;
+          break;
+        }
+    }
+  return copied / size;
+}
+
+/* Writes CNT elements of SIZE bytes each from BUFFER to STREAM.
+   Unless STREAM is unbuffered, writes smaller than its buffer are
+   collected there until it fills up, or, if STREAM is line
+   buffered, until a new-line is written; larger writes go
+   straight to the file.  Returns the number of whole elements
+   written, which is less than CNT on error. */
+size_t
+fwrite (const void *buffer, size_t size, size_t cnt, FILE *stream)
+{
+  size_t length = size * cnt;
+  int n;
+
+  if (length == 0)
+    return 0;
+  if (!(stream->flags & F_WRITE))
+    {
+      stream->flags |= F_ERR;
+      return 0;
+    }
+
+  if ((stream->in_cnt > 0 || stream->mode == _IONBF
+       || length > stream->size - stream->out_cnt)
+      && fflush (stream) == EOF)
+    return 0;
+
+  if (stream->mode != _IONBF && length < stream->size)
+    {
+      memcpy (stream->buf + stream->out_cnt, buffer, length);
+      stream->out_cnt += length;
+      if (stream->mode == _IOLBF && memchr (buffer, '\n', length) != NULL
+          && fflush (stream) == EOF)
+        return 0;
+      return cnt;
+    }
+
+  n = write (stream->fd, buffer, length);
+  if (n < 0 || (size_t) n < length)
+    {
+      stream->flags |= F_ERR;
+      if (n < 0)
+        return 0;
+    }
+  return n / size;
+}
+
+/* Reads and returns the next byte from STREAM as an unsigned
+   char, or EOF at end of file or on error. */
+int
+fgetc (FILE *stream)
+{
+  unsigned char c;
+
+  if (stream->in_ofs < stream->in_cnt)
+    return (unsigned char) stream->buf[stream->in_ofs++];
+  return fread (&c, 1, 1, stream) == 1 ? c : EOF;
+}
+
+/* Writes C, converted to unsigned char, to STREAM.  Returns the
+   byte written, or EOF on error. */
+int
+fputc (int c, FILE *stream)
+{
+  unsigned char c2 = c;
+
+  if (stream->out_cnt + 1 < stream->size && stream->in_cnt == 0
+      && stream->mode != _IONBF && (stream->flags & F_WRITE))
+    {
+      /* Fast path for a byte that fits in the buffer. */
+      stream->buf[stream->out_cnt++] = c2;
+      if (stream->mode == _IOLBF && c2 == '\n' && fflush (stream) == EOF)
+        return EOF;
+      return c2;
+    }
+  return fwrite (&c2, 1, 1, stream) == 1 ? c2 : EOF;
+}
+
+/* Writes string S to STREAM, without a trailing new-line.
+   Returns 0 if successful, EOF on error. */
+int
+fputs (const char *s, FILE *stream)
+{
+  size_t length = strlen (s);
+
+  return fwrite (s, 1, length, stream) == length ? 0 : EOF;
+}
+
+/* Auxiliary data for vfprintf_helper(). */
+struct vfprintf_aux
+  {
+    FILE *stream;       /* Output stream. */
+    int char_cnt;       /* Total characters written so far. */
+  };
+
+static void vfprintf_helper (char, void *);
+
+/* Formats the printf() format specification FORMAT with
+   arguments given in ARGS and writes the output to STREAM.
+   Returns the number of characters written.
+
+   Output to an unbuffered stream is collected in a temporary
+   buffer for the duration of the call, so that it still takes
+   one system call per 64 characters instead of one per
+   character. */
+int
+vfprintf (FILE *stream, const char *format, va_list args)
+{
+  struct vfprintf_aux aux;
+
+  aux.stream = stream;
+  aux.char_cnt = 0;
+  if (stream->mode == _IONBF)
+    {
+      char buf[64];
+      char *old_buf = stream->buf;
+      size_t old_size = stream->size;
+
+      stream->buf = buf;
+      stream->size = sizeof buf;
+      stream->mode = _IOFBF;
+      __vprintf (format, args, vfprintf_helper, &aux);
+      fflush (stream);
+      stream->buf = old_buf;
+      stream->size = old_size;
+      stream->mode = _IONBF;
+    }
+  else
+    __vprintf (format, args, vfprintf_helper, &aux);
+  return aux.char_cnt;
+}
+
+/* Helper function for vfprintf(). */
+static void
+vfprintf_helper (char c, void *aux_)
+{
+  struct vfprintf_aux *aux = aux_;
+
+  fputc (c, aux->stream);
+  aux->char_cnt++;
+}
+
+/* Like printf(), but writes output to STREAM. */
+int
+fprintf (FILE *stream, const char *format, ...)
+{
+  va_list args;
+  int retval;
+
+  va_start (args, format);
+  retval = vfprintf (stream, format, args);
+  va_end (args);
+
+  return retval;
+}
+
+/* Returns the file descriptor underlying STREAM. */
+int
+fileno (FILE *stream)
+{
+  return stream->fd;
+}
+
+/* Returns nonzero if a read from STREAM has reached end of
+   file. */
+int
+feof (FILE *stream)
+{
+  return (stream->flags & F_EOF) != 0;
+}
+
+/* Returns nonzero if a read from or write to STREAM has
+   failed. */
+int
+ferror (FILE *stream)
+{
+  return (stream->flags & F_ERR) != 0;
+}
+
+/* Clears STREAM's end of file and error indicators. */
+void
+clearerr (FILE *stream)
+{
+  stream->flags &= ~(F_EOF | F_ERR);
+}
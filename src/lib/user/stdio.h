@@ -1,6 +1,45 @@
 #ifndef __LIB_USER_STDIO_H
 #define __LIB_USER_STDIO_H
 
+/* Returned by fgetc() at end of file or on error, and by other
+   stream functions on error. */
+#define EOF (-1)
+
+/* Buffering modes for setvbuf(). */
+#define _IOFBF 0                /* Fully buffered. */
+#define _IOLBF 1                /* Line buffered. */
+#define _IONBF 2                /* Unbuffered. */
+
+/* Size of a stream's default buffer. */
+#define BUFSIZ 512
+
+/* Maximum number of streams open at once, including stdout. */
+#define FOPEN_MAX 8
+
+/* A buffered stream, defined in lib/user/stdio.c. */
+typedef struct __FILE FILE;
+
+/* The console, line buffered by default. */
+extern FILE *stdout;
+
+/* Buffered streams. */
+FILE *fopen (const char *name, const char *mode);
+FILE *fdopen (int fd, const char *mode);
+int fclose (FILE *);
+int fflush (FILE *);
+int setvbuf (FILE *, char *buf, int mode, size_t size);
+size_t fread (void *, size_t size, size_t cnt, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fgetc (FILE *);
+int fputc (int, FILE *);
+int fputs (const char *, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+int fileno (FILE *);
+int feof (FILE *);
+int ferror (FILE *);
+void clearerr (FILE *);
+
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
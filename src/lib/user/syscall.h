@@ -2,6 +2,7 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -12,9 +13,26 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* An element of a readv() or writev() vector. */
+struct iovec
+  {
+    void *iov_base;             /* Buffer. */
+    size_t iov_len;             /* Its length in bytes. */
+  };
+
+/* Maximum number of elements in a readv() or writev() vector. */
+#define IOV_MAX 64
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* A directory entry as stored by getdents(). */
+struct dirent
+  {
+    int d_ino;                          /* Inode number. */
+    char d_name[READDIR_MAX_LEN + 1];   /* Null terminated file name. */
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -45,4 +63,14 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool fallocate (int fd, unsigned offset, unsigned length);
+bool trace (bool enable);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int copy_file_range (int in_fd, int out_fd, unsigned length);
+int getdents (int fd, struct dirent *, unsigned size);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,57 @@
+/* Writes a file in small pieces through a buffered stream, reads
+   it back a byte at a time, appends to it, and then replaces it,
+   checking the file after each step. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 5000
+#define CHUNK_SIZE 7
+
+static char buf[TEST_SIZE];
+
+void
+test_main (void) 
+{
+  FILE *f;
+  size_t ofs;
+  int c;
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK ((f = fopen ("data", "w")) != NULL, "fopen \"data\" for writing");
+  for (ofs = 0; ofs < TEST_SIZE; ofs += CHUNK_SIZE)
+    {
+      size_t n = TEST_SIZE - ofs < CHUNK_SIZE ? TEST_SIZE - ofs : CHUNK_SIZE;
+      if (fwrite (buf + ofs, 1, n, f) != n)
+        fail ("fwrite at offset %zu failed", ofs);
+    }
+  CHECK (fclose (f) == 0, "fclose \"data\"");
+  check_file ("data", buf, TEST_SIZE);
+
+  CHECK ((f = fopen ("data", "r")) != NULL, "fopen \"data\" for reading");
+  for (ofs = 0; (c = fgetc (f)) != EOF; ofs++)
+    if (ofs >= TEST_SIZE || c != (unsigned char) buf[ofs])
+      fail ("fgetc at offset %zu returned wrong byte", ofs);
+  CHECK (ofs == TEST_SIZE && feof (f) && !ferror (f),
+         "fgetc to end of \"data\"");
+  CHECK (fclose (f) == 0, "fclose \"data\"");
+
+  CHECK ((f = fopen ("data", "a")) != NULL, "fopen \"data\" for appending");
+  CHECK (fprintf (f, "%d\n", 1234) == 5, "fprintf to \"data\"");
+  CHECK (fclose (f) == 0, "fclose \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (filesize (fd) == TEST_SIZE + 5, "filesize \"data\" after append");
+  msg ("close \"data\"");
+  close (fd);
+
+  CHECK ((f = fopen ("data", "w")) != NULL, "fopen \"data\" to replace it");
+  CHECK (fputs ("short", f) == 0, "fputs to \"data\"");
+  CHECK (fclose (f) == 0, "fclose \"data\"");
+  check_file ("data", "short", 5);
+}
@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(buffered) begin
+(buffered) fopen "data" for writing
+(buffered) fclose "data"
+(buffered) open "data" for verification
+(buffered) verified contents of "data"
+(buffered) close "data"
+(buffered) fopen "data" for reading
+(buffered) fgetc to end of "data"
+(buffered) fclose "data"
+(buffered) fopen "data" for appending
+(buffered) fprintf to "data"
+(buffered) fclose "data"
+(buffered) open "data"
+(buffered) filesize "data" after append
+(buffered) close "data"
+(buffered) fopen "data" to replace it
+(buffered) fputs to "data"
+(buffered) fclose "data"
+(buffered) open "data" for verification
+(buffered) verified contents of "data"
+(buffered) close "data"
+(buffered) end
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Child process for par-read test.
+   Reads every test file in chunks, starting with a different
+   file depending on its index, and verifies the contents. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/par-read.h"
+
+const char *test_name = "child-par-read";
+
+static char expected[BUF_SIZE];
+static char actual[CHUNK_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  int child_idx;
+  int i;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      int file_idx = (child_idx + i) % FILE_CNT;
+      char file_name[16];
+      size_t ofs;
+      int fd;
+
+      snprintf (file_name, sizeof file_name, "data%d", file_idx);
+      random_init (file_idx);
+      random_bytes (expected, sizeof expected);
+
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      for (ofs = 0; ofs < sizeof expected; ofs += CHUNK_SIZE)
+        {
+          CHECK (read (fd, actual, CHUNK_SIZE) == CHUNK_SIZE,
+                 "read \"%s\"", file_name);
+          compare_bytes (actual, expected + ofs, CHUNK_SIZE, ofs, file_name);
+        }
+      close (fd);
+    }
+
+  return child_idx;
+}
@@ -0,0 +1,43 @@
+/* Copies most of one file to another with copy_file_range,
+   starting part way into the source, and checks the result and
+   the positions of both files. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 40000
+#define SKIP 100
+
+static char buf[TEST_SIZE];
+
+void
+test_main (void) 
+{
+  int in_fd, out_fd;
+
+  random_init (13);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("source", 0), "create \"source\"");
+  CHECK ((in_fd = open ("source")) > 1, "open \"source\"");
+  CHECK (write (in_fd, buf, sizeof buf) == sizeof buf, "write \"source\"");
+  CHECK (create ("target", 0), "create \"target\"");
+  CHECK ((out_fd = open ("target")) > 1, "open \"target\"");
+
+  seek (in_fd, SKIP);
+  CHECK (copy_file_range (in_fd, out_fd, TEST_SIZE) == TEST_SIZE - SKIP,
+         "copy_file_range \"source\" to \"target\"");
+  CHECK (tell (in_fd) == TEST_SIZE, "tell \"source\"");
+  CHECK (tell (out_fd) == TEST_SIZE - SKIP, "tell \"target\"");
+  CHECK (copy_file_range (in_fd, out_fd, TEST_SIZE) == 0,
+         "copy_file_range at end of \"source\"");
+
+  msg ("close \"source\"");
+  close (in_fd);
+  msg ("close \"target\"");
+  close (out_fd);
+
+  check_file ("target", buf + SKIP, TEST_SIZE - SKIP);
+}
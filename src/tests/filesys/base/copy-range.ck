@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-range) begin
+(copy-range) create "source"
+(copy-range) open "source"
+(copy-range) write "source"
+(copy-range) create "target"
+(copy-range) open "target"
+(copy-range) copy_file_range "source" to "target"
+(copy-range) tell "source"
+(copy-range) tell "target"
+(copy-range) copy_file_range at end of "source"
+(copy-range) close "source"
+(copy-range) close "target"
+(copy-range) open "target" for verification
+(copy-range) verified contents of "target"
+(copy-range) close "target"
+(copy-range) end
+EOF
+pass;
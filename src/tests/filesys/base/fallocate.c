@@ -0,0 +1,47 @@
+/* Reserves space for a file with fallocate, checks that the
+   file grew and reads back as zeros, then writes the reserved
+   region and checks the result. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 8192
+
+static char buf[FILE_SIZE];
+static char zeros[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "prealloc";
+  size_t i;
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (fallocate (fd, 0, FILE_SIZE), "fallocate \"%s\"", file_name);
+  CHECK (filesize (fd) == FILE_SIZE, "filesize \"%s\"", file_name);
+  CHECK (tell (fd) == 0, "tell \"%s\"", file_name);
+
+  msg ("read \"%s\"", file_name);
+  if (read (fd, buf, sizeof buf) != sizeof buf)
+    fail ("read of reserved space failed");
+  if (memcmp (buf, zeros, sizeof buf))
+    fail ("reserved space does not read as zeros");
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = 'a' + i % 26;
+  msg ("write \"%s\"", file_name);
+  seek (fd, 100);
+  if (write (fd, buf + 100, sizeof buf - 200) != sizeof buf - 200)
+    fail ("write of reserved space failed");
+  memset (buf, 0, 100);
+  memset (buf + sizeof buf - 100, 0, 100);
+  CHECK (filesize (fd) == FILE_SIZE, "filesize \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  check_file (file_name, buf, sizeof buf);
+}
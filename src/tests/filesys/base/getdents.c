@@ -0,0 +1,62 @@
+/* Creates several files and lists the root directory with
+   getdents, a couple of entries at a time, checking that each
+   file is returned exactly once and that the directory cannot be
+   written through its fd. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 5
+
+void
+test_main (void) 
+{
+  struct dirent entries[2];
+  int seen[FILE_CNT];
+  int dir_fd;
+  int size;
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      seen[i] = 0;
+    }
+
+  CHECK ((dir_fd = open (".")) > 1, "open \".\"");
+  CHECK (write (dir_fd, "x", 1) == -1, "write \".\" (must return -1)");
+
+  msg ("getdents \".\"");
+  while ((size = getdents (dir_fd, entries, sizeof entries)) > 0)
+    {
+      int cnt = size / sizeof *entries;
+
+      if (size % sizeof *entries != 0 || cnt > 2)
+        fail ("getdents returned %d bytes", size);
+      for (i = 0; i < cnt; i++)
+        {
+          int n;
+
+          if (entries[i].d_ino == 0)
+            fail ("\"%s\" has inumber 0", entries[i].d_name);
+          if (strlen (entries[i].d_name) == 5
+              && !memcmp (entries[i].d_name, "file", 4)
+              && (n = entries[i].d_name[4] - '0') >= 0 && n < FILE_CNT)
+            seen[n]++;
+        }
+    }
+  CHECK (size == 0, "getdents at end of \".\"");
+
+  for (i = 0; i < FILE_CNT; i++)
+    if (seen[i] != 1)
+      fail ("\"file%d\" listed %d times", i, seen[i]);
+  msg ("all files listed once");
+
+  msg ("close \".\"");
+  close (dir_fd);
+}
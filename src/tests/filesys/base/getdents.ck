@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(getdents) begin
+(getdents) create "file0"
+(getdents) create "file1"
+(getdents) create "file2"
+(getdents) create "file3"
+(getdents) create "file4"
+(getdents) open "."
+(getdents) write "." (must return -1)
+(getdents) getdents "."
+(getdents) getdents at end of "."
+(getdents) all files listed once
+(getdents) close "."
+(getdents) end
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Creates several files and spawns child processes that all read
+   every file in parallel, each starting at a different file, so
+   that readers of unrelated files contend in the kernel file
+   system code at the same time. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/par-read.h"
+
+static char buf[BUF_SIZE];
+
+#define CHILD_CNT 6
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char file_name[16];
+      int fd;
+
+      snprintf (file_name, sizeof file_name, "data%d", i);
+      CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      random_init (i);
+      random_bytes (buf, sizeof buf);
+      CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+             "write \"%s\"", file_name);
+      msg ("close \"%s\"", file_name);
+      close (fd);
+    }
+
+  exec_children ("child-par-read", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
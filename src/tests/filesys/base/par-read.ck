@@ -0,0 +1,37 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(par-read) begin
+(par-read) create "data0"
+(par-read) open "data0"
+(par-read) write "data0"
+(par-read) close "data0"
+(par-read) create "data1"
+(par-read) open "data1"
+(par-read) write "data1"
+(par-read) close "data1"
+(par-read) create "data2"
+(par-read) open "data2"
+(par-read) write "data2"
+(par-read) close "data2"
+(par-read) create "data3"
+(par-read) open "data3"
+(par-read) write "data3"
+(par-read) close "data3"
+(par-read) exec child 1 of 6: "child-par-read 0"
+(par-read) exec child 2 of 6: "child-par-read 1"
+(par-read) exec child 3 of 6: "child-par-read 2"
+(par-read) exec child 4 of 6: "child-par-read 3"
+(par-read) exec child 5 of 6: "child-par-read 4"
+(par-read) exec child 6 of 6: "child-par-read 5"
+(par-read) wait for child 1 of 6 returned 0 (expected 0)
+(par-read) wait for child 2 of 6 returned 1 (expected 1)
+(par-read) wait for child 3 of 6 returned 2 (expected 2)
+(par-read) wait for child 4 of 6 returned 3 (expected 3)
+(par-read) wait for child 5 of 6 returned 4 (expected 4)
+(par-read) wait for child 6 of 6 returned 5 (expected 5)
+(par-read) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_BASE_PAR_READ_H
+#define TESTS_FILESYS_BASE_PAR_READ_H
+
+#define FILE_CNT 4
+#define BUF_SIZE 4096
+#define CHUNK_SIZE 512
+
+#endif /* tests/filesys/base/par-read.h */
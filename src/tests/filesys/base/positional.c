@@ -0,0 +1,61 @@
+/* Writes a file in random order with pwrite and reads it back
+   in a different random order with pread, checking that neither
+   moves the file position. */
+
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 313
+#define BLOCK_CNT 64
+#define TEST_SIZE (BLOCK_SIZE * BLOCK_CNT)
+
+char buf[TEST_SIZE];
+int order[BLOCK_CNT];
+
+void
+test_main (void) 
+{
+  const char *file_name = "positional";
+  int fd;
+  size_t i;
+
+  random_init (57);
+  random_bytes (buf, sizeof buf);
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    order[i] = i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  msg ("pwrite \"%s\" in random order", file_name);
+  shuffle (order, BLOCK_CNT, sizeof *order);
+  for (i = 0; i < BLOCK_CNT; i++) 
+    {
+      size_t ofs = BLOCK_SIZE * order[i];
+      if (pwrite (fd, buf + ofs, BLOCK_SIZE, ofs) != BLOCK_SIZE)
+        fail ("pwrite %d bytes at offset %zu failed", (int) BLOCK_SIZE, ofs);
+    }
+  CHECK (tell (fd) == 0, "tell \"%s\"", file_name);
+
+  msg ("pread \"%s\" in random order", file_name);
+  shuffle (order, BLOCK_CNT, sizeof *order);
+  for (i = 0; i < BLOCK_CNT; i++) 
+    {
+      char block[BLOCK_SIZE];
+      size_t ofs = BLOCK_SIZE * order[i];
+      if (pread (fd, block, BLOCK_SIZE, ofs) != BLOCK_SIZE)
+        fail ("pread %d bytes at offset %zu failed", (int) BLOCK_SIZE, ofs);
+      compare_bytes (block, buf + ofs, BLOCK_SIZE, ofs, file_name);
+    }
+  CHECK (tell (fd) == 0, "tell \"%s\"", file_name);
+  CHECK (pread (fd, buf, BLOCK_SIZE, TEST_SIZE) == 0,
+         "pread at end of \"%s\"", file_name);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
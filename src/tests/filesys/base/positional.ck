@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(positional) begin
+(positional) create "positional"
+(positional) open "positional"
+(positional) pwrite "positional" in random order
+(positional) tell "positional"
+(positional) pread "positional" in random order
+(positional) tell "positional"
+(positional) pread at end of "positional"
+(positional) close "positional"
+(positional) end
+EOF
+pass;
@@ -0,0 +1,61 @@
+/* Writes a file with writev from many small buffers, then reads
+   it back with readv into differently sized buffers. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 5000
+
+static char buf[TEST_SIZE];
+static char copy[TEST_SIZE];
+
+/* Divides BUFFER into CNT pieces of varying size, storing them
+   into IOV, which must have room for CNT elements. */
+static void
+split (char *buffer, struct iovec *iov, int cnt)
+{
+  size_t ofs = 0;
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t len = random_ulong () % (2 * TEST_SIZE / cnt);
+      if (len > TEST_SIZE - ofs || i == cnt - 1)
+        len = TEST_SIZE - ofs;
+      iov[i].iov_base = buffer + ofs;
+      iov[i].iov_len = len;
+      ofs += len;
+    }
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "vectored";
+  struct iovec iov[IOV_MAX];
+  int fd;
+
+  random_init (47);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  split (buf, iov, IOV_MAX);
+  CHECK (writev (fd, iov, IOV_MAX) == TEST_SIZE,
+         "writev %d buffers to \"%s\"", IOV_MAX, file_name);
+  CHECK (filesize (fd) == TEST_SIZE, "filesize \"%s\"", file_name);
+
+  seek (fd, 0);
+  split (copy, iov, 7);
+  CHECK (readv (fd, iov, 7) == TEST_SIZE,
+         "readv 7 buffers from \"%s\"", file_name);
+  compare_bytes (copy, buf, TEST_SIZE, 0, file_name);
+  CHECK (readv (fd, iov, 7) == 0, "readv at end of \"%s\"", file_name);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(vectored) begin
+(vectored) create "vectored"
+(vectored) open "vectored"
+(vectored) writev 64 buffers to "vectored"
+(vectored) filesize "vectored"
+(vectored) readv 7 buffers from "vectored"
+(vectored) readv at end of "vectored"
+(vectored) close "vectored"
+(vectored) end
+EOF
+pass;
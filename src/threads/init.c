@@ -28,6 +28,7 @@
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
+#include "userprog/syscall-trace.h"
 #include "userprog/tss.h"
 #else
 #include "tests/threads/tests.h"
@@ -35,6 +36,8 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -53,6 +56,9 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -ramdisk: Size of RAM disk "ram0" in sectors, or 0 for none. */
+static block_sector_t ramdisk_size;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -125,6 +131,9 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_blk_init ();
+  if (ramdisk_size > 0)
+    ramdisk_init (ramdisk_size);
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
@@ -251,6 +260,10 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-no-dma"))
+        ide_use_dma = false;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_size = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -263,6 +276,10 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-sysprof"))
+        syscall_profile = true;
+      else if (!strcmp (name, "-strace"))
+        syscall_trace_all = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -319,6 +336,7 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"iostats", 2, fsutil_iostats},
 #endif
       {NULL, 0, NULL},
     };
@@ -365,6 +383,7 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  iostats FILE       Write block I/O statistics to FILE as CSV.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -377,6 +396,8 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -no-dma            Transfer IDE disk data by PIO only.\n"
+          "  -ramdisk=SECTORS   Create RAM disk ram0 with SECTORS sectors.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -385,6 +406,8 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -sysprof           Print a system call profile at shutdown.\n"
+          "  -strace            Trace system calls to file `strace' on scratch.\n"
 #endif
           );
   shutdown_power_off ();
@@ -336,3 +336,88 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RWLOCK.  No thread holds it initially. */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init (&rwlock->lock);
+  cond_init (&rwlock->readers_ok);
+  cond_init (&rwlock->writer_ok);
+  rwlock->reader_cnt = 0;
+  rwlock->waiting_writer_cnt = 0;
+  rwlock->writer = false;
+}
+
+/* Acquires RWLOCK for reading, sleeping until no writer holds
+   or waits for it.  A thread must not acquire a readers-writer
+   lock recursively.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rwlock->lock);
+  while (rwlock->writer || rwlock->waiting_writer_cnt > 0)
+    cond_wait (&rwlock->readers_ok, &rwlock->lock);
+  rwlock->reader_cnt++;
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+   reading.  The last reader out lets a waiting writer in. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->reader_cnt > 0);
+  if (--rwlock->reader_cnt == 0)
+    cond_signal (&rwlock->writer_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no other thread
+   holds it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rwlock->lock);
+  rwlock->waiting_writer_cnt++;
+  while (rwlock->writer || rwlock->reader_cnt > 0)
+    cond_wait (&rwlock->writer_ok, &rwlock->lock);
+  rwlock->waiting_writer_cnt--;
+  rwlock->writer = true;
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+   writing.  Hands the lock to the next waiting writer if there
+   is one, otherwise to all waiting readers. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->writer);
+  rwlock->writer = false;
+  if (rwlock->waiting_writer_cnt > 0)
+    cond_signal (&rwlock->writer_ok, &rwlock->lock);
+  else
+    cond_broadcast (&rwlock->readers_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
@@ -41,6 +41,26 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.
+   Any number of readers may hold the lock at once, but a writer
+   holds it exclusively.  Waiting writers block new readers, so
+   a steady stream of readers cannot starve a writer. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readers_ok;/* Signaled when readers may enter. */
+    struct condition writer_ok; /* Signaled when a writer may enter. */
+    int reader_cnt;             /* Number of readers holding the lock. */
+    int waiting_writer_cnt;     /* Number of writers waiting. */
+    bool writer;                /* True if a writer holds the lock. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
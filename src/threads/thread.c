@@ -644,29 +644,3 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
-/* Check if a thread executes a given filename */
-bool
-file_executed (const char * f_name)
-{
-  struct list_elem *e;
-  struct thread *t;
-  char *p_name, *aux, *buf;
-  for (e = list_begin (&all_list); e != list_tail (&all_list);
-       e = list_next (e))
-    {
-      t = list_entry (e, struct thread, allelem);
-      // get filename
-      buf = malloc (strlen (t->name)+1);
-      ASSERT (strlcpy (buf, t->name, strlen (t->name) + 1) > 0);
-      aux = buf;
-      p_name = strtok_r (NULL, " ", &aux);
-      if (strcmp (p_name, f_name) == 0)
-        {
-          free (buf);
-          return true;
-        }
-      free (buf);
-    }
-  return false;
-}
-
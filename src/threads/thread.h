@@ -94,6 +94,8 @@ struct exit_status
                                            >0 if so <0 otherwise */
   };
 
+struct file_descriptor;
+
 /* memory mapping */
 struct mmapping 
 {
@@ -138,6 +140,18 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */    
+    struct file *executable;            /* Executable, denied writes. */
+
+    /* Owned by userprog/syscall.c. */
+    struct file_descriptor **fds;       /* Open files, indexed by fd. */
+    int fd_cnt;                         /* Number of slots in fds. */
+    void *user_esp;                     /* User stack pointer on entry
+                                           to the current system call. */
+    bool trace_syscalls;                /* Record system calls? */
+#endif
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of open transactions. */
 #endif
     
     struct hash suppl_page_table;       /* Supplemental Page Table */
@@ -184,6 +198,4 @@ void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
-bool file_executed (const char *);
-
 #endif
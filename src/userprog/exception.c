@@ -8,6 +8,7 @@
 #include "userprog/syscall.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
+#include "userprog/uaccess.h"
 #include "vm/frametable.h"
 #include "vm/swaptable.h"
 #include <string.h>
@@ -17,6 +18,7 @@ static long long page_fault_cnt;
 
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
+static void bad_access (struct intr_frame *, bool user);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -134,6 +136,7 @@ page_fault (struct intr_frame *f)
   bool write;        /* True: access was write, false: access was read. */
   bool user;         /* True: access by user, false: access by kernel. */
   void *fault_addr;  /* Fault address. */
+  void *esp;         /* User stack pointer. */
 
   /* Obtain faulting address, the virtual address that was
      accessed to cause the fault.  It may point to code or to
@@ -156,18 +159,24 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;    
 
+  /* The stack pointer is only saved in F for a fault in user
+     context.  In kernel context, use the one saved on entry to
+     the system call. */
+  esp = user ? f->esp : thread_current ()->user_esp;
+
   /* terminate user process if read/write to kernel or page not present */
   if ((user && is_kernel_vaddr (fault_addr)) || (write && !not_present))
     {     
       if (explain) 
         printf("User tried to access kernel space, or write to r/o memory\n");
-      exit (-1);     
+      bad_access (f, user);
+      return;
     }
   /* Try to load a page that is not present */
   else if (not_present)
     {      
       // Check for a stack access and grow the stack if necessary
-      if (fault_addr >= f->esp - 32 && fault_addr >= PHYS_BASE - MAX_STACK_SIZE_BYTES)
+      if (fault_addr >= esp - 32 && fault_addr >= PHYS_BASE - MAX_STACK_SIZE_BYTES)
         {                              
           // Assume that this is a stack access and grow it accordingly
           void* kpage = frametable_get_page ();
@@ -206,7 +215,8 @@ page_fault (struct intr_frame *f)
             {
               if (explain) 
                 printf("load_segment failed\n");
-              exit (-1);
+              bad_access (f, user);
+              return;
             }
         }
       else if (spte == NULL)
@@ -216,11 +226,13 @@ page_fault (struct intr_frame *f)
               if (explain) 
                 printf("Weird address %p, after %d page_faults\n", fault_addr, 
                        (int)page_fault_cnt);
-              exit (-1);
+              bad_access (f, user);
+              return;
             }
           if (explain) 
             printf("No Supplemental Page Table entry found for %p\n", upage);          
-          exit (-1);
+          bad_access (f, user);
+          return;
         }
     }
   
@@ -236,3 +248,15 @@ page_fault:
   kill (f);
 }
 
+/* Handles a page fault that cannot be satisfied.  If the kernel
+   caused it in one of the user memory accessors in
+   userprog/uaccess.c, resumes at the accessor's fixup so that
+   the failure is reported to its caller.  Otherwise terminates
+   the user process. */
+static void
+bad_access (struct intr_frame *f, bool user)
+{
+  if (!user && uaccess_fixup (f))
+    return;
+  exit (-1);
+}
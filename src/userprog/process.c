@@ -189,6 +189,10 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+
+  /* Allow writes to the executable again. */
+  file_close (cur->executable);
+  cur->executable = NULL;
 }
 
 /* Sets up the CPU for running user code in the current
@@ -308,6 +312,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
       goto done; 
     }
 
+  /* Keep the executable open, with writes denied, until the
+     process exits.  Its pages are loaded from it on demand. */
+  file_deny_write (file);
+  t->executable = file;
+
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
@@ -390,8 +399,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
   success = true;
 
  done:
-  /* We arrive here whether the load is successful or not. */
-  //file_close (file);
+  /* We arrive here whether the load is successful or not.
+     The executable stays open either way and is closed by
+     process_exit(). */
   return success;
 }
 
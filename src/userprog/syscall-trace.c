@@ -0,0 +1,203 @@
+#include "userprog/syscall-trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "filesys/fsutil.h"
+#endif
+
+/* System call tracing.
+
+   When tracing is on for a process, syscall_handler() records an
+   event on entry to each of its system calls, with the call's
+   arguments, and another on return, with its return value.
+   Events go into a single ring buffer shared by all processes,
+   which keeps the most recent TRACE_EVENT_CNT of them.
+
+   At shutdown the buffer is appended to the ustar archive on the
+   scratch device as file "strace", so that it can be copied out
+   with the pintos script's -G option (not -g, which would have
+   the kernel append a file of that name itself) and decoded on
+   the host by utils/pintos-strace.  The file consists of a struct
+   trace_header followed by the events, oldest first, in the
+   machine's byte order. */
+
+/* Number of pages in the ring buffer. */
+#define TRACE_PAGES 16
+
+/* An event. */
+struct trace_event
+  {
+    uint64_t tsc;               /* Time stamp counter. */
+    int32_t tid;                /* Thread that made the call. */
+    uint16_t nr;                /* System call number. */
+    uint8_t type;               /* TRACE_ENTER or TRACE_EXIT. */
+    uint8_t argc;               /* Number of values used in VAL. */
+    uint32_t val[4];            /* Arguments, or return value. */
+  };
+
+/* Event types. */
+#define TRACE_ENTER 0           /* Entry, VAL holds arguments. */
+#define TRACE_EXIT 1            /* Return, VAL[0] holds return value. */
+
+/* Number of events in the ring buffer. */
+#define TRACE_EVENT_CNT \
+        (TRACE_PAGES * PGSIZE / sizeof (struct trace_event))
+
+/* Header of the trace file.  The time stamps of the first and
+   last events, together with the timer ticks at those moments,
+   let the decoder convert TSC cycles to wall-clock time. */
+struct trace_header
+  {
+    char magic[4];              /* TRACE_MAGIC. */
+    uint16_t version;           /* TRACE_VERSION. */
+    uint16_t event_size;        /* sizeof (struct trace_event). */
+    uint32_t event_cnt;         /* Number of events that follow. */
+    uint32_t dropped;           /* Older events overwritten. */
+    uint32_t timer_freq;        /* Timer ticks per second. */
+    uint32_t unused;
+    uint64_t start_tsc;         /* TSC when tracing started. */
+    int64_t start_ticks;        /* Timer ticks then. */
+    uint64_t end_tsc;           /* TSC when the trace was written. */
+    int64_t end_ticks;          /* Timer ticks then. */
+  };
+
+#define TRACE_MAGIC "PSTR"
+#define TRACE_VERSION 1
+
+bool syscall_trace_all;
+
+/* Ring buffer, allocated when tracing first starts. */
+static struct trace_event *events;
+static uint32_t event_head;     /* Total number of events recorded. */
+static uint64_t start_tsc;      /* TSC when tracing started. */
+static int64_t start_ticks;     /* Timer ticks then. */
+
+/* Returns the processor's time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Allocates the ring buffer, if that has not been done yet.
+   Returns true if successful, false if memory is short. */
+bool
+syscall_trace_start (void)
+{
+  if (events == NULL)
+    {
+      struct trace_event *buf = palloc_get_multiple (0, TRACE_PAGES);
+      if (buf == NULL)
+        return false;
+      start_ticks = timer_ticks ();
+      start_tsc = rdtsc ();
+      events = buf;
+    }
+  return true;
+}
+
+/* Returns true if the running thread's system calls are being
+   traced. */
+static bool
+tracing (void)
+{
+  return (syscall_trace_all || thread_current ()->trace_syscalls)
+         && events != NULL;
+}
+
+/* Records an event of the given TYPE for system call NR with the
+   ARGC values in VAL. */
+static void
+record (int type, int nr, int argc, const uint32_t val[])
+{
+  struct trace_event *e;
+  enum intr_level old_level;
+
+  ASSERT (argc <= 4);
+
+  old_level = intr_disable ();
+  e = &events[event_head++ % TRACE_EVENT_CNT];
+  e->tsc = rdtsc ();
+  e->tid = thread_tid ();
+  e->nr = nr;
+  e->type = type;
+  e->argc = argc;
+  memset (e->val, 0, sizeof e->val);
+  memcpy (e->val, val, argc * sizeof *val);
+  intr_set_level (old_level);
+}
+
+/* Records entry into system call NR with the ARGC arguments in
+   ARGS, if the running thread is being traced. */
+void
+syscall_trace_enter (int nr, int argc, const uint32_t args[])
+{
+  if (tracing ())
+    record (TRACE_ENTER, nr, argc, args);
+}
+
+/* Records return from system call NR with RETVAL, if the running
+   thread is being traced. */
+void
+syscall_trace_exit (int nr, uint32_t retval)
+{
+  if (tracing ())
+    record (TRACE_EXIT, nr, 1, &retval);
+}
+
+/* Appends the trace to the ustar archive on the scratch device,
+   if anything was traced. */
+void
+syscall_trace_dump (void)
+{
+#ifdef FILESYS
+  struct trace_header *h;
+  uint8_t *file;
+  uint32_t cnt, first, i;
+  size_t size;
+
+  if (events == NULL || event_head == 0)
+    return;
+
+  cnt = event_head < TRACE_EVENT_CNT ? event_head : TRACE_EVENT_CNT;
+  size = sizeof *h + cnt * sizeof *events;
+  file = palloc_get_multiple (0, DIV_ROUND_UP (size, PGSIZE));
+  if (file == NULL)
+    {
+      printf ("strace: out of memory, trace not written\n");
+      return;
+    }
+
+  h = (struct trace_header *) file;
+  memset (h, 0, sizeof *h);
+  memcpy (h->magic, TRACE_MAGIC, sizeof h->magic);
+  h->version = TRACE_VERSION;
+  h->event_size = sizeof *events;
+  h->event_cnt = cnt;
+  h->dropped = event_head - cnt;
+  h->timer_freq = TIMER_FREQ;
+  h->start_tsc = start_tsc;
+  h->start_ticks = start_ticks;
+  h->end_tsc = rdtsc ();
+  h->end_ticks = timer_ticks ();
+
+  first = event_head - cnt;
+  for (i = 0; i < cnt; i++)
+    memcpy (file + sizeof *h + i * sizeof *events,
+            &events[(first + i) % TRACE_EVENT_CNT], sizeof *events);
+
+  printf ("strace: %"PRIu32" events, %"PRIu32" dropped\n", cnt, h->dropped);
+  fsutil_append_buffer ("strace", file, size);
+  palloc_free_multiple (file, DIV_ROUND_UP (size, PGSIZE));
+#endif
+}
@@ -0,0 +1,16 @@
+#ifndef USERPROG_SYSCALL_TRACE_H
+#define USERPROG_SYSCALL_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* If true, trace the system calls of every process.
+   Controlled by kernel command-line option "-strace". */
+extern bool syscall_trace_all;
+
+bool syscall_trace_start (void);
+void syscall_trace_enter (int nr, int argc, const uint32_t args[]);
+void syscall_trace_exit (int nr, uint32_t retval);
+void syscall_trace_dump (void);
+
+#endif /* userprog/syscall-trace.h */
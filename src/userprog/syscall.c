@@ -12,30 +12,45 @@
 #include "threads/synch.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "userprog/syscall-trace.h"
+#include "userprog/uaccess.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
 #include "devices/shutdown.h"
 #include "lib/kernel/list.h"
 
 struct file_descriptor {
-  int fd_id;            /* FD unique identifier */
-  tid_t owner;	        /* thread/process holding this FD */
   struct file *file;    /* reference to filesystem */
-  struct list_elem elem;/* element for open_files list */
-  char *exec_name;      /* name of the file (used to prevent ivalid writes)
-                           in case it is executed currently */
+  bool is_dir;          /* open on a directory? */
 };
 
-struct list open_files;
-struct lock file_lock;
-int get_unique_fd_id (void);
-struct file_descriptor* get_open_file (int fd);
+/* An element of a readv() or writev() vector, laid out as in
+   lib/user/syscall.h. */
+struct iovec 
+  {
+    void *iov_base;             /* User address of buffer. */
+    size_t iov_len;             /* Its length in bytes. */
+  };
+
+/* Maximum number of elements in a readv() or writev() vector. */
+#define IOV_MAX 64
+
+/* Number of pages in the buffer copy_file_range() copies through,
+   if that many are free. */
+#define COPY_PAGES 8
+
+/* Initial number of slots in a process's fd table, which
+   doubles in size whenever it fills up. */
+#define FD_TABLE_INIT 16
+
+int alloc_fd (struct file_descriptor *);
 struct file_descriptor* get_owned_file (int fd);
 
 static void syscall_handler (struct intr_frame *);
 
-bool is_valid_uaddr(const void *);
-bool are_valid_uaddrs(const void *, int);
+char *copy_in_string (const char *);
 
 void halt (void);
 void exit (int) NO_RETURN;
@@ -51,150 +66,168 @@ int mmap (int fd, void* vaddr);
 void munmap (int mmap_id);
 unsigned tell (int);
 void close (int);
+bool fallocate (int, unsigned, unsigned);
+int pread (int, void *, unsigned, unsigned);
+int pwrite (int, const void *, unsigned, unsigned);
+int readv (int, const struct iovec *, int);
+int writev (int, const struct iovec *, int);
+int copy_file_range (int, int, unsigned);
+int getdents (int, struct dirent *, unsigned);
+bool trace (bool);
+
+/* System call handler, called with the call's arguments.  Each
+   handler takes its own argument types, which all fit in 32 bits,
+   and the caller passes the maximum number of arguments, of
+   which the handler uses only as many as it declares. */
+typedef uint32_t syscall_func (uint32_t, uint32_t, uint32_t, uint32_t);
+
+/* A system call. */
+struct syscall 
+  {
+    const char *name;           /* Name, for profiling output. */
+    int argc;                   /* Number of arguments. */
+    syscall_func *func;         /* Handler. */
+    unsigned long long cnt;     /* Number of calls. */
+    uint64_t total_cycles;      /* Sum of their latencies, in TSC cycles. */
+    uint64_t max_cycles;        /* Longest latency, in TSC cycles. */
+  };
+
+/* Casts handler F to syscall_func, going through a generic
+   function pointer type so that GCC accepts the change of
+   signature. */
+#define SYSCALL(NAME, ARGC, F) \
+        {NAME, ARGC, (syscall_func *) (void (*) (void)) (F), 0, 0, 0}
+
+/* Table of system calls, indexed by system call number. */
+static struct syscall syscalls[] = 
+  {
+    [SYS_HALT] = SYSCALL ("halt", 0, halt),
+    [SYS_EXIT] = SYSCALL ("exit", 1, exit),
+    [SYS_EXEC] = SYSCALL ("exec", 1, exec_call),
+    [SYS_WAIT] = SYSCALL ("wait", 1, process_wait),
+    [SYS_CREATE] = SYSCALL ("create", 2, create),
+    [SYS_REMOVE] = SYSCALL ("remove", 1, remove),
+    [SYS_OPEN] = SYSCALL ("open", 1, open),
+    [SYS_FILESIZE] = SYSCALL ("filesize", 1, filesize),
+    [SYS_READ] = SYSCALL ("read", 3, read),
+    [SYS_WRITE] = SYSCALL ("write", 3, write),
+    [SYS_SEEK] = SYSCALL ("seek", 2, seek),
+    [SYS_TELL] = SYSCALL ("tell", 1, tell),
+    [SYS_CLOSE] = SYSCALL ("close", 1, close),
+    [SYS_MMAP] = SYSCALL ("mmap", 2, mmap),
+    [SYS_MUNMAP] = SYSCALL ("munmap", 1, munmap),
+    [SYS_FALLOCATE] = SYSCALL ("fallocate", 3, fallocate),
+    [SYS_TRACE] = SYSCALL ("trace", 1, trace),
+    [SYS_PREAD] = SYSCALL ("pread", 4, pread),
+    [SYS_PWRITE] = SYSCALL ("pwrite", 4, pwrite),
+    [SYS_READV] = SYSCALL ("readv", 3, readv),
+    [SYS_WRITEV] = SYSCALL ("writev", 3, writev),
+    [SYS_COPY_FILE_RANGE] = SYSCALL ("copy_file_range", 3, copy_file_range),
+    [SYS_GETDENTS] = SYSCALL ("getdents", 3, getdents),
+  };
+
+/* Number of entries in syscalls[]. */
+#define SYSCALL_CNT (sizeof syscalls / sizeof *syscalls)
+
+/* If true, print a profile of system calls at shutdown.
+   Controlled by kernel command-line option "-sysprof". */
+bool syscall_profile;
+
+/* Returns the processor's time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  list_init (&open_files);
-  lock_init (&file_lock);
+  if (syscall_trace_all && !syscall_trace_start ())
+    PANIC ("out of memory for system call trace");
 }
 
-/* Closes all files of the given thread. */
+/* Closes all files of the given thread and frees its fd table. */
 void release_files (struct thread* cur) 
 {
-    /* close all owned files */
-    struct list_elem *e;
-    struct file_descriptor *fds;
+    int fd;
 
-    lock_acquire(&file_lock);
-    for (e = list_begin(&open_files); e != list_tail(&open_files); e = list_next(e)) 
-    {
-        fds = list_entry(e, struct file_descriptor, elem);
-        if (fds->owner == cur->tid) 
-        {
-            e = list_prev(e);
-            list_remove(&fds->elem);
-            file_close(fds->file);
-            free(fds->exec_name);
-            free(fds);
-        }
-    }
-    lock_release(&file_lock);    
+    for (fd = 0; fd < cur->fd_cnt; fd++)
+      {
+        struct file_descriptor *fds = cur->fds[fd];
+        if (fds != NULL)
+          {
+            file_close (fds->file);
+            free (fds);
+          }
+      }
+    free (cur->fds);
+    cur->fds = NULL;
+    cur->fd_cnt = 0;
 }
 
 static void
 syscall_handler (struct intr_frame *f) 
 {
-  uint32_t* esp = f->esp;
-  
-  /* is zero-th parameter in userspace? */
-  if (!is_valid_uaddr (esp))
+  uint32_t *esp = f->esp;
+  uint32_t args[4] = {0, 0, 0, 0}; /* System call arguments. */
+  unsigned syscall_nr;
+  struct syscall *sc;
+  uint64_t start, cycles;
+  enum intr_level old_level;
+
+  thread_current ()->user_esp = f->esp;
+  if (!copy_from_user (&syscall_nr, esp, sizeof syscall_nr)
+      || syscall_nr >= SYSCALL_CNT || syscalls[syscall_nr].func == NULL)
     {
       exit (-1);
-    }  
-  int syscall_nr = *esp;
-  
-  /* check all other parameters */
-
-  /* check first parameter */
-  switch (syscall_nr)
-    {
-      case SYS_EXIT:
-      case SYS_EXEC:
-      case SYS_WAIT:
-      case SYS_CREATE:
-      case SYS_REMOVE:
-      case SYS_OPEN:
-      case SYS_FILESIZE:
-      case SYS_READ:
-      case SYS_WRITE:
-      case SYS_SEEK:
-      case SYS_TELL:
-      case SYS_CLOSE:
-      case SYS_MMAP:
-      case SYS_MUNMAP:
-        if (!is_valid_uaddr (esp + 1))
-          {
-            exit (-1);
-          } 
-    }
-  
-  /* check second parameter */
-  switch (syscall_nr)
-    {
-      case SYS_CREATE:
-      case SYS_READ:
-      case SYS_WRITE:
-      case SYS_SEEK:
-      case SYS_MMAP:
-        if (!is_valid_uaddr (esp + 2))
-          {
-            exit (-1);
-          } 
     }
-	
-  /* check third parameter */
-  switch (syscall_nr)
+  sc = &syscalls[syscall_nr];
+
+  /* copy parameters from the user stack */
+  if (!copy_from_user (args, esp + 1, sc->argc * sizeof *args))
     {
-      case SYS_READ:
-      case SYS_WRITE:
-      if (!is_valid_uaddr (esp + 3))
-        {
-          exit (-1);
-        } 
+      exit (-1);
     }
-	
-  /* execute system call */
-  switch (syscall_nr)
-    {
-      case SYS_HALT:
-        shutdown_power_off ();
-        break;
-      case SYS_EXIT:
-        exit (* (esp + 1));
-        break;
-      case SYS_EXEC:
-        f->eax = exec_call ( (char *) * (esp + 1));
-        break;
-      case SYS_WAIT:
-        f->eax = process_wait (* (esp + 1));
-        break;
-      case SYS_CREATE:
-        f->eax = create ( (char *) * (esp + 1), * (esp + 2));
-        break;
-      case SYS_REMOVE:
-        f->eax = remove ( (char *) * (esp + 1));
-        break;
-      case SYS_OPEN:
-        f->eax = open ( (char *) * (esp + 1));
-        break;
-      case SYS_FILESIZE:
-        f->eax = filesize (* (esp + 1));
-        break;
-      case SYS_READ:
-        f->eax = read (* (esp + 1), (void *) * (esp + 2), * (esp + 3));
-        break;
-      case SYS_WRITE:
-        f->eax = write (* (esp + 1), (void *) * (esp + 2), * (esp + 3));
-        break;
-      case SYS_SEEK:
-        seek (* (esp + 1), * (esp + 2));
-        break;
-      case SYS_TELL:
-        f->eax = tell (*(esp + 1));
-        break;
-      case SYS_CLOSE:
-        close (* (esp + 1));
-        break;
-      case SYS_MMAP:
-        f->eax = mmap (*(esp + 1), *(esp + 2));
-        break;
-      case SYS_MUNMAP:
-        munmap (*(esp + 1));
-        break;
-      default:
-        exit (-1);
+
+  /* execute system call, counting it first in case it does not
+     return.  The counters are shared by all threads and are 64
+     bits wide, so they are updated with interrupts off. */
+  old_level = intr_disable ();
+  sc->cnt++;
+  intr_set_level (old_level);
+  syscall_trace_enter (syscall_nr, sc->argc, args);
+  start = rdtsc ();
+  f->eax = sc->func (args[0], args[1], args[2], args[3]);
+  cycles = rdtsc () - start;
+  old_level = intr_disable ();
+  sc->total_cycles += cycles;
+  if (cycles > sc->max_cycles)
+    sc->max_cycles = cycles;
+  intr_set_level (old_level);
+  syscall_trace_exit (syscall_nr, f->eax);
+}
+
+/* Prints the system call profile, if enabled. */
+void
+syscall_print_stats (void) 
+{
+  size_t i;
+
+  if (!syscall_profile)
+    return;
+  printf ("System calls:\n");
+  for (i = 0; i < SYSCALL_CNT; i++)
+    {
+      const struct syscall *sc = &syscalls[i];
+      if (sc->cnt > 0)
+        printf ("  %-10s %8llu calls, avg %llu cycles, max %llu cycles\n",
+                sc->name, sc->cnt,
+                (unsigned long long) (sc->total_cycles / sc->cnt),
+                (unsigned long long) sc->max_cycles);
     }
 }
 
@@ -235,27 +268,29 @@ tid_t
 exec_call (const char *file)
 {
   tid_t new_pid = -1;
+  char *cmd_line = copy_in_string (file);
   /* get filename */
   char *p_name, *aux, *buf = palloc_get_page ( (enum palloc_flags)0);
   if (buf == NULL)
     {
+      palloc_free_page (cmd_line);
       return -1;
     }
-  ASSERT (strlcpy (buf, file, PGSIZE) > 0);
+  ASSERT (strlcpy (buf, cmd_line, PGSIZE) > 0);
   aux = buf;
   p_name = strtok_r (NULL, " ", &aux);
 
   /* look if file exists */
-  lock_acquire (&file_lock);
   struct file *f = filesys_open (p_name);
-  lock_release (&file_lock);
   palloc_free_page (buf);
 
   /* if file exists create new process */
   if (f != NULL)
     {
-      new_pid = process_execute (file);
+      file_close (f);
+      new_pid = process_execute (cmd_line);
     }
+  palloc_free_page (cmd_line);
   return new_pid;
 }
 
@@ -266,15 +301,10 @@ is a separate operation which would require a open system call. */
 bool 
 create (const char *file, unsigned initial_size)
 {
-  if (!is_valid_uaddr (file))
-    {
-      exit (-1);
-    }
-  bool ret = false;
-  lock_acquire (&file_lock);
-  ret = filesys_create (file, initial_size);
-  lock_release (&file_lock);
-  return ret;
+  char *name = copy_in_string (file);
+  bool success = filesys_create (name, initial_size);
+  palloc_free_page (name);
+  return success;
 }
 
 /* Deletes the file called file. Returns true if successful, 
@@ -284,15 +314,10 @@ close it */
 bool 
 remove (const char *file) 
 {
-  if (!is_valid_uaddr (file))
-    {
-      exit (-1);
-    }
-  bool ret = false;
-  lock_acquire (&file_lock);
-  ret = filesys_remove (file);
-  lock_release (&file_lock);
-  return ret;
+  char *name = copy_in_string (file);
+  bool success = filesys_remove (name);
+  palloc_free_page (name);
+  return success;
 }
 
 /* Opens the file called file. Returns a nonnegative integer 
@@ -304,16 +329,10 @@ open (const char *file)
   struct file_descriptor *fd;
   struct file *f;
   int status = -1;
-
-  /* check if pointer is in userspace */
-  if (!is_valid_uaddr (file))
-    {
-      exit (-1);
-    }
+  char *name = copy_in_string (file);
 	
   /* get file */
-  lock_acquire (&file_lock);
-  f = filesys_open (file);
+  f = filesys_open (name);
   if (f != NULL)
     {
       fd = (struct file_descriptor *) malloc (sizeof (struct file_descriptor));
@@ -325,18 +344,18 @@ open (const char *file)
         }
       else
         {
-          fd->fd_id = get_unique_fd_id ();
-          fd->owner = thread_current ()->tid;
           fd->file = f;
-
-          fd->exec_name = malloc (strlen (file) + 1); 
-          ASSERT (strlcpy (fd->exec_name, file, strlen (file) + 1) > 0);
-       
-         list_push_back (&open_files, &fd->elem);
-         status = fd->fd_id;
-       }
-   }
-  lock_release (&file_lock);
+          fd->is_dir = (inode_get_inumber (file_get_inode (f))
+                        == ROOT_DIR_SECTOR);
+          status = alloc_fd (fd);
+          if (status == -1)
+            {
+              file_close (f);
+              free (fd);
+            }
+        }
+    }
+  palloc_free_page (name);
   return status;
 }
 
@@ -345,13 +364,11 @@ int
 filesize (int fd) 
 {
   int ret = -1;
-  lock_acquire (&file_lock);
   struct file_descriptor* fds = get_owned_file (fd);
   if (fds != NULL)
     {
       ret = file_length (fds->file);
     }
-  lock_release (&file_lock);
   return ret;
 }
 
@@ -468,7 +485,7 @@ int mmap (int fd, void* vaddr)
   // Allocate pages for the file content
   void* pages = frametable_get_pages (num_pages);
   int bytes_left = length;  
-  int pos_before = tell (fd);
+  struct file *file = get_owned_file (fd)->file;
   
   // Read file content into pages
   for (i = 0; i < num_pages; i++)
@@ -484,8 +501,8 @@ int mmap (int fd, void* vaddr)
       if (!success)
         PANIC ("Could not install Page");
       
-      // read file content into page
-      read (fd, upage, read_bytes);      
+      // read file content into page, leaving the file position alone
+      file_read_at (file, kpage, read_bytes, i * PGSIZE);
       bytes_left -= read_bytes;
       
       // fill the rest of the last page with zeroes
@@ -495,9 +512,6 @@ int mmap (int fd, void* vaddr)
         }
     }       
   
-  // reset file position
-  seek (fd, pos_before);
-  
   // Create Memory Mapping entry
   struct mmapping* mapping = malloc (sizeof(struct mmapping));
   mapping->fd = fd;
@@ -511,6 +525,93 @@ int mmap (int fd, void* vaddr)
   return mapping->mmap_id;
 }
 
+/* Reads up to length bytes from file into user buffer through
+a kernel page, starting at offset, or at the file's current
+position if offset is -1, which it advances.  Returns the number
+of bytes read, or -1 if no page could be allocated.  Terminates
+the process if buffer is not writable user memory. */
+static int
+read_to_user (struct file *file, void *buffer, unsigned length,
+              off_t offset)
+{
+  int status = 0;
+  uint8_t *page = palloc_get_page (0);
+  if (page == NULL)
+    {
+      return -1;
+    }
+  while (length > 0)
+    {
+      unsigned chunk = length < PGSIZE ? length : PGSIZE;
+      off_t cnt = (offset < 0
+                   ? file_read (file, page, chunk)
+                   : file_read_at (file, page, chunk, offset + status));
+      if (!copy_to_user ((uint8_t *) buffer + status, page, cnt))
+        {
+          palloc_free_page (page);
+          exit (-1);
+        }
+      status += cnt;
+      length -= cnt;
+      if ((unsigned) cnt < chunk)
+        {
+          break;
+        }
+    }
+  palloc_free_page (page);
+  return status;
+}
+
+/* Writes up to length bytes from user buffer through a kernel
+page to file, or to the console if file is null.  Writes to file
+start at offset, or at the file's current position if offset is
+-1, which it advances.  Returns the number of bytes written, or
+-1 if no page could be allocated.  Terminates the process if
+buffer is not readable user memory. */
+static int
+write_from_user (struct file *file, const void *buffer, unsigned length,
+                 off_t offset)
+{
+  int status = 0;
+  uint8_t *page = palloc_get_page (0);
+  if (page == NULL)
+    {
+      return -1;
+    }
+  while (length > 0)
+    {
+      unsigned chunk = length < PGSIZE ? length : PGSIZE;
+      off_t cnt;
+      if (!copy_from_user (page, (const uint8_t *) buffer + status, chunk))
+        {
+          palloc_free_page (page);
+          exit (-1);
+        }
+      if (file == NULL)
+        {
+          /* write to stdout */
+          putbuf ((const char *) page, chunk);
+          cnt = chunk;
+        }
+      else if (offset < 0)
+        {
+          cnt = file_write (file, page, chunk);
+        }
+      else
+        {
+          cnt = file_write_at (file, page, chunk, offset + status);
+        }
+      status += cnt;
+      length -= cnt;
+      if ((unsigned) cnt < chunk)
+        {
+          break;
+        }
+    }
+  palloc_free_page (page);
+  return status;
+}
+
 /* Reads size bytes from the file open as fd into buffer. 
 Returns the number of bytes actually read (0 at end of file), 
 or -1 if the file could not be read (due to a condition other 
@@ -518,12 +619,7 @@ than end of file). */
 int 
 read (int fd, void *buffer, unsigned length) 
 {
-  if (!are_valid_uaddrs (buffer, length))
-    {      
-      exit (-1);
-    }
   int status = 0;
-  lock_acquire (&file_lock);
   if (fd == STDOUT_FILENO)
     {
       status = -1;
@@ -536,28 +632,30 @@ read (int fd, void *buffer, unsigned length)
       char* buf = (char *) buffer;
       while (length > 1 && (c = input_getc ()))
         {
-          buf[i] = c;
+          if (!copy_to_user (buf + i, &c, 1))
+            {
+              exit (-1);
+            }
           i++;
           length--;
         }
-      buf[i] = 0;
+      c = 0;
+      if (length > 0 && !copy_to_user (buf + i, &c, 1))
+        {
+          exit (-1);
+        }
       status = i;
     }
   else 
     {
-      /* write to file */
+      /* read from file */
       struct file_descriptor* fds = get_owned_file(fd);
-      if (fds != NULL)
+      if (fds == NULL)
         {
-          status = file_read(fds->file, buffer, length);
-        }
-      else
-        {
-          lock_release (&file_lock);
           exit (-1);
         }
+      status = read_to_user (fds->file, buffer, length, -1);
     }
-  lock_release (&file_lock);
   return status;
 }
 
@@ -567,45 +665,376 @@ be less than size if some bytes could not be written.  */
 int 
 write (int fd, const void *buffer, unsigned length) 
 {
-  if (!are_valid_uaddrs (buffer, length))
+  struct file_descriptor* fds;
+  if (fd == STDIN_FILENO)
+    {
+      return -1;
+    }
+  else if (fd == STDOUT_FILENO) 
+    {
+      return write_from_user (NULL, buffer, length, -1);
+    }
+
+  /* write to file, unless it is being executed, in which case
+     its inode denies the write */
+  fds = get_owned_file (fd);
+  if (fds == NULL)
+    {
+      exit (-1);
+    }
+  if (fds->is_dir)
+    {
+      return -1;
+    }
+  return write_from_user (fds->file, buffer, length, -1);
+}
+
+/* Reads size bytes from the file open as fd into buffer, 
+starting at offset bytes from the beginning of the file, without 
+using or changing the file's position.  Returns the number of 
+bytes actually read (0 at end of file), or -1 if fd is not an 
+open file or offset is out of range. */
+int 
+pread (int fd, void *buffer, unsigned length, unsigned offset) 
+{
+  struct file_descriptor* fds;
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO || offset > INT32_MAX)
+    {
+      return -1;
+    }
+  fds = get_owned_file (fd);
+  if (fds == NULL)
+    {
+      exit (-1);
+    }
+  if (length > INT32_MAX - offset)
+    {
+      length = INT32_MAX - offset;
+    }
+  return read_to_user (fds->file, buffer, length, offset);
+}
+
+/* Writes size bytes from buffer to the file open as fd, starting 
+at offset bytes from the beginning of the file, without using or 
+changing the file's position.  Returns the number of bytes 
+actually written, or -1 if fd is not an open file or offset is 
+out of range. */
+int 
+pwrite (int fd, const void *buffer, unsigned length, unsigned offset) 
+{
+  struct file_descriptor* fds;
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO || offset > INT32_MAX)
+    {
+      return -1;
+    }
+  fds = get_owned_file (fd);
+  if (fds == NULL)
+    {
+      exit (-1);
+    }
+  if (fds->is_dir)
+    {
+      return -1;
+    }
+  if (length > INT32_MAX - offset)
+    {
+      length = INT32_MAX - offset;
+    }
+  return write_from_user (fds->file, buffer, length, offset);
+}
+
+/* Copies the iovcnt elements of user vector uiov into a newly
+allocated kernel array and returns it, storing the total length
+of its buffers into *total.  The caller must free the array.
+Returns a null pointer if iovcnt is out of range, the total
+length does not fit in an int, or memory is short.  Terminates
+the process if uiov is not readable user memory. */
+static struct iovec *
+copy_in_iovec (const struct iovec *uiov, int iovcnt, size_t *total)
+{
+  struct iovec *iov;
+  int i;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX)
+    {
+      return NULL;
+    }
+  iov = malloc (iovcnt * sizeof *iov);
+  if (iov == NULL)
+    {
+      return NULL;
+    }
+  if (!copy_from_user (iov, uiov, iovcnt * sizeof *iov))
+    {
+      free (iov);
+      exit (-1);
+    }
+  *total = 0;
+  for (i = 0; i < iovcnt; i++)
+    {
+      if (iov[i].iov_len > INT32_MAX - *total)
+        {
+          free (iov);
+          return NULL;
+        }
+      *total += iov[i].iov_len;
+    }
+  return iov;
+}
+
+/* Reads from the file open as fd into the iovcnt buffers
+described by iov, filling each in turn, as if by a single read()
+into one buffer of their total length.  The file is read a page
+at a time into a kernel page, so that each page takes a single
+file system call however the buffers divide it.  Returns the
+number of bytes actually read (0 at end of file), or -1 if fd is
+not an open file or iov is invalid. */
+int 
+readv (int fd, const struct iovec *iov_, int iovcnt) 
+{
+  struct file_descriptor* fds;
+  struct iovec *iov;
+  size_t total;
+  uint8_t *page;
+  int status = 0;
+  int i = 0;                    /* Current element of iov. */
+  size_t ofs = 0;               /* Offset within element i. */
+
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO)
+    {
+      return -1;
+    }
+  fds = get_owned_file (fd);
+  if (fds == NULL)
     {
       exit (-1);
     }
+  if (iovcnt == 0)
+    {
+      return 0;
+    }
+  iov = copy_in_iovec (iov_, iovcnt, &total);
+  if (iov == NULL)
+    {
+      return -1;
+    }
+  page = palloc_get_page (0);
+  if (page == NULL)
+    {
+      free (iov);
+      return -1;
+    }
+
+  while (total > 0)
+    {
+      unsigned chunk = total < PGSIZE ? total : PGSIZE;
+      off_t cnt = file_read (fds->file, page, chunk);
+      off_t done = 0;
+
+      /* scatter the page across the buffers */
+      while (done < cnt)
+        {
+          size_t n = iov[i].iov_len - ofs;
+          if (n > (size_t) (cnt - done))
+            {
+              n = cnt - done;
+            }
+          if (!copy_to_user ((uint8_t *) iov[i].iov_base + ofs,
+                             page + done, n))
+            {
+              palloc_free_page (page);
+              free (iov);
+              exit (-1);
+            }
+          done += n;
+          ofs += n;
+          if (ofs == iov[i].iov_len)
+            {
+              i++;
+              ofs = 0;
+            }
+        }
+      status += cnt;
+      total -= cnt;
+      if ((unsigned) cnt < chunk)
+        {
+          break;
+        }
+    }
+  palloc_free_page (page);
+  free (iov);
+  return status;
+}
+
+/* Writes the iovcnt buffers described by iov, in order, to the
+open file fd, as if by a single write() of one buffer holding all
+of them.  The buffers are gathered into a kernel page, so that a
+page of small buffers takes a single file system call and
+partial sectors are rewritten once rather than once per buffer.
+Returns the number of bytes actually written, or -1 if fd is not
+an open file or iov is invalid. */
+int 
+writev (int fd, const struct iovec *iov_, int iovcnt) 
+{
+  struct file_descriptor* fds = NULL;
+  struct iovec *iov;
+  size_t total;
+  uint8_t *page;
   int status = 0;
-  lock_acquire (&file_lock);
+  int i = 0;                    /* Current element of iov. */
+  size_t ofs = 0;               /* Offset within element i. */
+
   if (fd == STDIN_FILENO)
     {
-      status = -1;
+      return -1;
     }
-  else if (fd == STDOUT_FILENO) 
+  else if (fd != STDOUT_FILENO)
     {
-      /* write to stdout */
-      putbuf (buffer, length);
-      status = (int) length;
+      fds = get_owned_file (fd);
+      if (fds == NULL)
+        {
+          exit (-1);
+        }
+      if (fds->is_dir)
+        {
+          return -1;
+        }
     }
-  else 
+  if (iovcnt == 0)
+    {
+      return 0;
+    }
+  iov = copy_in_iovec (iov_, iovcnt, &total);
+  if (iov == NULL)
+    {
+      return -1;
+    }
+  page = palloc_get_page (0);
+  if (page == NULL)
     {
-      /* write to file if not executed */
-      struct file_descriptor* fds = get_owned_file (fd);
-      if (fds != NULL)
+      free (iov);
+      return -1;
+    }
+
+  while (total > 0)
+    {
+      unsigned chunk = total < PGSIZE ? total : PGSIZE;
+      unsigned fill = 0;
+      off_t cnt;
+
+      /* gather the buffers into the page */
+      while (fill < chunk)
         {
-          if (file_executed (fds->exec_name))
+          size_t n = iov[i].iov_len - ofs;
+          if (n > chunk - fill)
             {
-              file_deny_write (fds->file);
+              n = chunk - fill;
             }
-          else
+          if (!copy_from_user (page + fill,
+                               (const uint8_t *) iov[i].iov_base + ofs, n))
             {
-              file_allow_write (fds->file);
+              palloc_free_page (page);
+              free (iov);
+              exit (-1);
             }
-          status = file_write (fds->file, buffer, length);
+          fill += n;
+          ofs += n;
+          if (ofs == iov[i].iov_len)
+            {
+              i++;
+              ofs = 0;
+            }
+        }
+
+      if (fds == NULL)
+        {
+          /* write to stdout */
+          putbuf ((const char *) page, chunk);
+          cnt = chunk;
         }
       else
         {
-          lock_release (&file_lock);
-	  exit (-1);
+          cnt = file_write (fds->file, page, chunk);
+        }
+      status += cnt;
+      total -= cnt;
+      if ((unsigned) cnt < chunk)
+        {
+          break;
+        }
+    }
+  palloc_free_page (page);
+  free (iov);
+  return status;
+}
+
+/* Copies up to length bytes from the file open as in_fd, starting
+at its current position, to the file open as out_fd, starting at
+its current position, and advances both positions.  The data is
+copied through a kernel buffer of several pages and never passes
+through user memory, and each buffer's worth is read and written
+with multi-sector requests where the positions allow.  Returns
+the number of bytes copied, which is less than length at end of
+the input file or if the output cannot be written, or -1 if
+either fd is not an open file or no memory is available. */
+int 
+copy_file_range (int in_fd, int out_fd, unsigned length) 
+{
+  struct file_descriptor *in, *out;
+  size_t buf_size = COPY_PAGES * PGSIZE;
+  uint8_t *buf;
+  int status = 0;
+
+  if (in_fd == STDIN_FILENO || in_fd == STDOUT_FILENO
+      || out_fd == STDIN_FILENO || out_fd == STDOUT_FILENO)
+    {
+      return -1;
+    }
+  in = get_owned_file (in_fd);
+  out = get_owned_file (out_fd);
+  if (in == NULL || out == NULL)
+    {
+      exit (-1);
+    }
+  if (out->is_dir)
+    {
+      return -1;
+    }
+  if (length > INT32_MAX)
+    {
+      length = INT32_MAX;
+    }
+
+  buf = palloc_get_multiple (0, COPY_PAGES);
+  if (buf == NULL)
+    {
+      buf_size = PGSIZE;
+      buf = palloc_get_page (0);
+      if (buf == NULL)
+        {
+          return -1;
+        }
+    }
+
+  while (length > 0)
+    {
+      off_t chunk = length < buf_size ? length : buf_size;
+      off_t cnt = file_read (in->file, buf, chunk);
+      off_t written = file_write (out->file, buf, cnt);
+      status += written;
+      length -= written;
+      if (written < cnt)
+        {
+          /* give back what could not be written */
+          file_seek (in->file, file_tell (in->file) - (cnt - written));
+          break;
+        }
+      if (cnt < chunk)
+        {
+          break;
         }
     }
-  lock_release(&file_lock);
+  palloc_free_multiple (buf, buf_size / PGSIZE);
   return status;
 }
 
@@ -615,13 +1044,11 @@ the beginning of the file. */
 void 
 seek (int fd, unsigned position)
 {
-  lock_acquire (&file_lock);
   struct file_descriptor* fds = get_owned_file (fd);
   if (fds != NULL)
     {
       file_seek (fds->file, position);
     }
-  lock_release (&file_lock);
 }
 
 /* Returns the position of the next byte to be read 
@@ -631,13 +1058,11 @@ unsigned
 tell (int fd) 
 {
   unsigned ret = 0;
-  lock_acquire (&file_lock);
   struct file_descriptor* fds = get_owned_file (fd);
   if (fds != NULL)
     {
       ret = file_tell (fds->file);
     }
-  lock_release (&file_lock);
   return ret;
 }
 
@@ -649,110 +1074,168 @@ void
 close (int fd) 
 {
   struct file_descriptor *fds;
-  lock_acquire (&file_lock);
   fds = get_owned_file (fd);
   if (fds != NULL)
     {
-      list_remove (&fds->elem);
+      thread_current ()->fds[fd] = NULL;
       file_close (fds->file);
-      free (fds->exec_name);	
       free (fds);
     }
   else
     {
-      lock_release (&file_lock);
       exit (-1);
     }
-  lock_release (&file_lock);
 }
 
-/* Checks if given address is a vaild userprocess address. */
+/* Reserves disk space for the length bytes of open file fd
+starting at offset, extending the file if they lie past its
+end, so that writing them later cannot fail for lack of space.
+Returns true if successful, false otherwise. */
 bool
-is_valid_uaddr (const void *upointer) 
+fallocate (int fd, unsigned offset, unsigned length)
 {
-  struct thread *cur = thread_current ();
-  if (upointer != NULL && is_user_vaddr (upointer))
-    {      
-      return (pagedir_get_page (cur->pagedir, upointer)) != NULL;
+  struct file_descriptor* fds = get_owned_file (fd);
+  if (fds == NULL)
+    {
+      exit (-1);
+    }
+  if (fds->is_dir || offset > INT32_MAX || length > INT32_MAX - offset)
+    {
+      return false;
+    }
+  return file_fallocate (fds->file, offset, length);
+}
+
+/* Reads the entries of the directory open as fd, starting at
+its current position, into buf as an array of struct dirent,
+storing as many whole entries as fit in size bytes, and advances
+the position past them.  Returns the number of bytes stored,
+which is 0 once every entry has been read, or -1 if fd is not
+open on a directory or size cannot hold a single entry. */
+int
+getdents (int fd, struct dirent *buf, unsigned size)
+{
+  struct file_descriptor* fds;
+  struct dirent *entries;
+  size_t max;
+  size_t cnt;
+  off_t pos;
+
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO)
+    {
+      return -1;
+    }
+  fds = get_owned_file (fd);
+  if (fds == NULL)
+    {
+      exit (-1);
     }
-  return false; 
+  if (!fds->is_dir || size < sizeof *entries)
+    {
+      return -1;
+    }
+
+  max = size / sizeof *entries;
+  if (max > PGSIZE / sizeof *entries)
+    {
+      max = PGSIZE / sizeof *entries;
+    }
+  entries = palloc_get_page (0);
+  if (entries == NULL)
+    {
+      return -1;
+    }
+
+  pos = file_tell (fds->file);
+  cnt = dir_read_entries (file_get_inode (fds->file), &pos, entries, max);
+  file_seek (fds->file, pos);
+  if (!copy_to_user (buf, entries, cnt * sizeof *entries))
+    {
+      palloc_free_page (entries);
+      exit (-1);
+    }
+  palloc_free_page (entries);
+  return cnt * sizeof *entries;
 }
 
-/* Check if the whole memory area from given pointer to pointer + offset
-is valid in userporcess space */
+/* Turns tracing of the current process's system calls on or off,
+according to enable.  Returns true if successful, false if memory
+for the trace buffer could not be obtained. */
 bool
-are_valid_uaddrs (const void *upointer, int size) 
+trace (bool enable)
 {
-  while(size > 0) 
+  if (enable && !syscall_trace_start ())
     {
-      /* check current "page" */
-      if (!is_valid_uaddr (upointer))
-        {
-	  return false;
-        }
-        /* get next "page" */
-        if(size >= PGSIZE)
-          {
-            size -= PGSIZE;
-            upointer += PGSIZE;
-          }
-        else
-          {
-            /* check last address */
-            upointer += size - 1;
-            size = 0;
-            if (!is_valid_uaddr (upointer)) 
-              {
-                return false;	
-              }
-       }
+      return false;
     }
+  thread_current ()->trace_syscalls = enable;
   return true;
 }
 
-/* Returns a new unique file descriptor id */
-int
-get_unique_fd_id () 
+/* Copies the null-terminated string at user address ustr into
+a newly allocated page and returns it.  The caller must free the
+page with palloc_free_page().  Terminates the process if the
+string is not in readable user memory or is longer than a page,
+or if no page can be allocated. */
+char *
+copy_in_string (const char *ustr)
 {
-  static int id = STDOUT_FILENO + 1;
-  return id++;
+  char *kstr = palloc_get_page (0);
+  if (kstr == NULL)
+    {
+      exit (-1);
+    }
+  if (strncpy_from_user (kstr, ustr, PGSIZE) < 0)
+    {
+      palloc_free_page (kstr);
+      exit (-1);
+    }
+  return kstr;
 }
 
-/* Get a opened file by its fd */
-struct file_descriptor *
-get_open_file (int fd) 
+/* Stores FDS in the lowest free slot of the current process's
+   fd table, growing the table if it is full, and returns its fd.
+   Returns -1 if memory for a larger table cannot be obtained. */
+int
+alloc_fd (struct file_descriptor *fds) 
 {
-  struct list_elem *e;
-  struct file_descriptor *fds; 
-  for(e = list_begin (&open_files); e!=list_tail (&open_files); 
-      e = list_next (e))
+  struct thread *cur = thread_current ();
+  int fd;
+
+  for (fd = STDOUT_FILENO + 1; fd < cur->fd_cnt; fd++)
+    if (cur->fds[fd] == NULL)
+      break;
+
+  if (fd >= cur->fd_cnt)
     {
-      fds = list_entry (e, struct file_descriptor, elem);
-      if (fds->fd_id == fd)
+      int new_cnt = cur->fd_cnt > 0 ? cur->fd_cnt * 2 : FD_TABLE_INIT;
+      struct file_descriptor **new_fds;
+
+      new_fds = realloc (cur->fds, new_cnt * sizeof *new_fds);
+      if (new_fds == NULL)
         {
-          return fds;
+          return -1;
         }
+      memset (new_fds + cur->fd_cnt, 0,
+              (new_cnt - cur->fd_cnt) * sizeof *new_fds);
+      cur->fds = new_fds;
+      cur->fd_cnt = new_cnt;
     }
-  return NULL;
+
+  cur->fds[fd] = fds;
+  return fd;
 }
 
-/* Get the file if current_thread is the owner. */
+/* Returns the file open as fd in the current process.
+   Terminates the process if fd is not open. */
 struct file_descriptor *
 get_owned_file (int fd) 
 {
-  struct file_descriptor* fds = get_open_file (fd);
-  if (fds == NULL)
+  struct thread *cur = thread_current ();
+
+  if (fd < 0 || fd >= cur->fd_cnt || cur->fds[fd] == NULL)
     {
-      /* always call with file_lock hold */
-      lock_release (&file_lock);
       exit (-1);
     }
-  if (fds->owner == thread_current ()->tid)
-    {
-      return fds;
-    }
-  else
-    {
-      return NULL;
-    }
+  return cur->fds[fd];
 }
@@ -3,7 +3,11 @@
 
 #include "threads/thread.h"
 
+/* If true, print a system call profile at shutdown. */
+extern bool syscall_profile;
+
 void syscall_init (void);
+void syscall_print_stats (void);
 
 void exit (int);
 
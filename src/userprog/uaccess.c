@@ -0,0 +1,144 @@
+#include "userprog/uaccess.h"
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Accessing user memory.
+
+   The functions below access user memory directly, without
+   first checking that it is mapped.  An access to a page that is
+   valid but not present faults it in like any other page fault.
+   An access that the page fault handler cannot satisfy, because
+   the address is unmapped or the page is read-only, does not
+   kill the process: the handler finds the faulting instruction
+   in the fixup table and resumes execution at the instruction's
+   fixup address instead, from which the function reports the
+   failure to its caller.
+
+   Each instruction that may fault on a user address is paired
+   with its fixup address by emitting an entry into the
+   __ex_table section, which the linker script gathers between
+   _start_ex_table and _end_ex_table. */
+
+/* Fixup table entry. */
+struct fixup
+  {
+    uintptr_t insn;             /* Address of faulting instruction. */
+    uintptr_t fixup;            /* Where to resume after a fault. */
+  };
+
+/* Fixup table bounds, from the linker script. */
+extern const struct fixup _start_ex_table[], _end_ex_table[];
+
+/* Returns true if the SIZE bytes starting at user address UADDR
+   lie entirely below PHYS_BASE. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+  return start <= (uintptr_t) PHYS_BASE
+         && size <= (uintptr_t) PHYS_BASE - start;
+}
+
+/* Copies SIZE bytes from SRC to DST, either of which may be a
+   user address, with "rep movsb".  A fault part way through
+   leaves ECX holding the number of bytes not yet copied, since
+   the string instruction is restartable after each byte, so the
+   fixup just resumes after it.  Returns the number of bytes that
+   were not copied, 0 if successful. */
+static size_t
+raw_copy (void *dst, const void *src, size_t size)
+{
+  asm volatile ("1: rep movsb\n"
+                "2:\n"
+                ".section __ex_table, \"a\"\n"
+                ".long 1b, 2b\n"
+                ".previous"
+                : "+D" (dst), "+S" (src), "+c" (size)
+                :
+                : "memory");
+  return size;
+}
+
+/* Reads a byte at user virtual address UADDR, which must be
+   below PHYS_BASE.  Returns the byte value if successful, -1 if
+   the access faulted. */
+static inline int
+get_user (const uint8_t *uaddr)
+{
+  int result = -1;
+  asm volatile ("1: movzbl %1, %0\n"
+                "2:\n"
+                ".section __ex_table, \"a\"\n"
+                ".long 1b, 2b\n"
+                ".previous"
+                : "+r" (result)
+                : "m" (*uaddr));
+  return result;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel buffer DST.
+   Returns true if successful, false if any byte of USRC is not
+   a readable user address, in which case DST's contents are
+   indeterminate. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return is_user_range (usrc, size) && raw_copy (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from kernel buffer SRC to user address UDST.
+   Returns true if successful, false if any byte of UDST is not a
+   writable user address, in which case some of the bytes may
+   have been written anyway. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return is_user_range (udst, size) && raw_copy (udst, src, size) == 0;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   kernel buffer DST, which has room for SIZE bytes, including
+   the null terminator.  Returns the length of the string, not
+   including the null terminator, if successful.  Returns -1 if
+   the string is longer than SIZE - 1 bytes or if any byte of it
+   is not a readable user address. */
+int
+strncpy_from_user (char *dst, const char *usrc, size_t size)
+{
+  const uint8_t *src = (const uint8_t *) usrc;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      int c;
+
+      if (!is_user_vaddr (src + i))
+        return -1;
+      c = get_user (src + i);
+      if (c < 0)
+        return -1;
+      dst[i] = c;
+      if (c == '\0')
+        return i;
+    }
+  return -1;
+}
+
+/* Called by the page fault handler for a fault in kernel context
+   that it could not satisfy.  If F's faulting instruction is one
+   of the user memory accesses above, redirects F to resume at
+   its fixup address and returns true.  Otherwise returns false. */
+bool
+uaccess_fixup (struct intr_frame *f)
+{
+  const struct fixup *e;
+
+  for (e = _start_ex_table; e < _end_ex_table; e++)
+    if (e->insn == (uintptr_t) f->eip)
+      {
+        f->eip = (void (*) (void)) e->fixup;
+        return true;
+      }
+  return false;
+}
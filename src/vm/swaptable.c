@@ -69,14 +69,11 @@ swap_write (void* page_vaddr)
   if (slot == BITMAP_ERROR)
     PANIC("#############\nOMAGAWD SWAP IS FULL. NEED MOAR! \n###########");
   
-  // Write content from page into swap
+  // Write content from page into swap, all sectors in one request
   int baseSector = slot * SECTORS_PER_SLOT;
-  int i;
+  struct block_sg sg = { page_vaddr, SECTORS_PER_SLOT };
   
-  for (i = 0; i < SECTORS_PER_SLOT; i++)
-    {      
-      block_write (swap, baseSector + i, page_vaddr + (i * BLOCK_SECTOR_SIZE));
-    }  
+  block_write_multiple (swap, baseSector, SECTORS_PER_SLOT, &sg);
   
   // Create entry in swap map
   struct swap_mapping* entry = malloc(sizeof(struct swap_mapping));
@@ -116,14 +113,11 @@ swap_read (void* page_vaddr)
   void* kpage = frametable_get_page ();
   ASSERT (kpage != NULL);
 
-  // Read content from swap into page
+  // Read content from swap into page, all sectors in one request
   int baseSector = mapping->slot * SECTORS_PER_SLOT;
-  int i;
+  struct block_sg sg = { kpage, SECTORS_PER_SLOT };
   
-  for (i = 0; i < SECTORS_PER_SLOT; i++)
-    {      
-      block_read (swap, baseSector + i, kpage + (i * BLOCK_SECTOR_SIZE));
-    }
+  block_read_multiple (swap, baseSector, SECTORS_PER_SLOT, &sg);
   
   // Add page to the process's address space
   struct page_suppl* spte = suppl_get (page_vaddr);